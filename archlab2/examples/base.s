@@ -0,0 +1,40 @@
+# base ISA: fib(0) .. fib(19) to sram[100 .. 119], then xor / or over them
+# and the other ALU ops on the results, to sram[120 .. 127]
+ADD 2 0 0 0		# 0: i = 0
+ADD 3 0 0 0		# 1: a = fib(0)
+ADD 4 1 0 1		# 2: b = fib(1)
+ADD 5 1 0 20		# 3: n = 20
+ADD 6 2 1 100		# 4: loop: r6 = 100 + i
+ST 0 3 6 0		# 5: sram[100 + i] = a
+ADD 6 3 4 0		# 6: r6 = a + b
+ADD 3 4 0 0		# 7: a = b
+ADD 4 6 0 0		# 8: b = r6
+ADD 2 2 1 1		# 9: i++
+JLT 0 2 5 4		# 10: while i < n
+ADD 2 0 0 0		# 11: i = 0
+ADD 3 0 0 0		# 12: x = 0
+ADD 4 0 0 0		# 13: o = 0
+ADD 6 2 1 100		# 14: loop: r6 = 100 + i
+LD 6 0 6 0		# 15: r6 = sram[100 + i]
+XOR 3 3 6 0		# 16: x ^= r6
+OR 4 4 6 0		# 17: o |= r6
+ADD 2 2 1 1		# 18: i++
+JNE 0 2 5 14		# 19: while i != n
+ST 0 3 1 120		# 20
+ST 0 4 1 121		# 21
+LSF 6 3 1 3		# 22
+ST 0 6 1 122		# 23
+RSF 6 4 1 2		# 24
+ST 0 6 1 123		# 25
+AND 6 3 4 0		# 26
+ST 0 6 1 124		# 27
+SUB 6 3 4 0		# 28
+ST 0 6 1 125		# 29
+LHI 6 3 1 0xabcd	# 30: r6 = 0xabcd << 16 | x & 0xffff
+ST 0 6 1 126		# 31
+JLE 0 4 3 35		# 32: not taken, o > x
+JEQ 0 0 0 36		# 33: taken
+HLT 0 0 0 0		# 34
+HLT 0 0 0 0		# 35
+ST 0 7 1 127		# 36: r7, pc of the last taken jump
+HLT 0 0 0 0		# 37
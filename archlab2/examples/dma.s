@@ -0,0 +1,31 @@
+# MEMCPY / DMAPOL: fills sram[200 .. 263] with i * i, copies them to
+# sram[300 .. 363] while the cpu sums them with loads that compete with the
+# DMA for the sram, polls for the end of the copy and stores the sum to
+# sram[400] and the last copied word to sram[401]
+ADD 2 0 0 0		# 0: i = 0
+ADD 3 0 0 0		# 1: sq = 0
+ADD 5 1 0 64		# 2: n = 64
+ADD 6 2 1 200		# 3: loop: r6 = 200 + i
+ST 0 3 6 0		# 4: sram[200 + i] = i * i
+ADD 3 3 2 0		# 5: sq += 2 * i + 1
+ADD 3 3 2 0		# 6
+ADD 3 3 1 1		# 7
+ADD 2 2 1 1		# 8: i++
+JLT 0 2 5 3		# 9: while i < n
+ADD 2 1 0 200		# 10: src
+ADD 4 1 0 300		# 11: dst
+MEMCPY 0 2 4 64		# 12
+ADD 3 0 0 0		# 13: sum = 0
+ADD 4 1 0 264		# 14: end
+LD 6 0 2 0		# 15: loop: r6 = sram[src]
+ADD 3 3 6 0		# 16: sum += r6
+ADD 2 2 1 1		# 17: src++
+JLT 0 2 4 15		# 18: while src < end
+ADD 2 1 0 1		# 19
+DMAPOL 4 0 0 0		# 20: poll: r4 = DMA idle
+JNE 0 4 2 20		# 21: while busy
+ST 0 3 1 400		# 22
+ADD 2 1 0 363		# 23
+LD 4 0 2 0		# 24
+ST 0 4 1 401		# 25
+HLT 0 0 0 0		# 26
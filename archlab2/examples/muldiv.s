@@ -0,0 +1,47 @@
+# multiply / divide unit: a table of a * b, a / b, a % b and the high word
+# of a * b for signed pairs to sram[100 ..], including division by zero and
+# 0x80000000 / -1
+SUB 2 0 1 7		# 0: a = -7
+ADD 3 1 0 3		# 1: b
+ADD 5 1 0 100		# 2: p = 100
+MUL 4 2 3 0		# 3
+ST 0 4 5 0		# 4
+ADD 5 5 1 1		# 5
+DIV 4 2 3 0		# 6
+ST 0 4 5 0		# 7
+ADD 5 5 1 1		# 8
+REM 4 2 3 0		# 9
+ST 0 4 5 0		# 10
+ADD 5 5 1 1		# 11
+MULH 4 2 3 0		# 12
+ST 0 4 5 0		# 13
+ADD 5 5 1 1		# 14
+ADD 3 0 0 0		# 15: b = 0
+DIV 4 2 3 0		# 16
+ST 0 4 5 0		# 17
+ADD 5 5 1 1		# 18
+REM 4 2 3 0		# 19
+ST 0 4 5 0		# 20
+ADD 5 5 1 1		# 21
+LHI 2 0 1 0x8000	# 22: a = 0x80000000
+SUB 3 0 1 1		# 23: b = -1
+DIV 4 2 3 0		# 24
+ST 0 4 5 0		# 25
+ADD 5 5 1 1		# 26
+REM 4 2 3 0		# 27
+ST 0 4 5 0		# 28
+ADD 5 5 1 1		# 29
+MULH 4 2 2 0		# 30
+ST 0 4 5 0		# 31
+ADD 5 5 1 1		# 32
+LHI 3 1 1 0x1234	# 33: b = 0x12341234
+MUL 4 3 3 0		# 34: back to back, the second waits for the unit
+MULH 6 3 3 0		# 35
+ST 0 4 5 0		# 36
+ADD 5 5 1 1		# 37
+ST 0 6 5 0		# 38
+ADD 5 5 1 1		# 39
+SUB 3 0 1 5		# 40: b = -5
+DIV 4 6 3 0		# 41
+ST 0 4 5 0		# 42
+HLT 0 0 0 0		# 43
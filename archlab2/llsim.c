@@ -1,13 +1,50 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+#include <limits.h>
 #include "llsim.h"
 
 /*
  * chip simulator
  */
 llsim_t *llsim = NULL;
+__thread llsim_unit_t *llsim_current_unit = NULL;
+static int nr_units = 0;
 static int stop_sim = 0;
+void (*llsim_fail_hook)(void) = NULL;
+
+/*
+ * parameter values given on the command line, picked up by
+ * llsim_register_param()
+ */
+typedef struct llsim_param_value_s {
+	char *name;
+	int val;
+	int used;
+	struct llsim_param_value_s *next;
+} llsim_param_value_t;
+
+static llsim_param_value_t *param_values = NULL;
+
+/*
+ * output files of the units, reopened in the working directory of a
+ * forked sweep child
+ */
+typedef struct llsim_file_s {
+	char *name;
+	FILE *fp;
+	struct llsim_file_s *next;
+} llsim_file_t;
+
+static llsim_file_t *files = NULL;
+
+void llsim_fail(void)
+{
+	if (llsim_fail_hook)
+		llsim_fail_hook();
+	exit(1);
+}
 
 void *llsim_malloc(int len)
 {
@@ -19,6 +56,21 @@ void *llsim_malloc(int len)
 	return p;
 }
 
+/*
+ * zeroed, LLSIM_MEM_ALIGN aligned allocation. the length is rounded up to a
+ * whole number of alignment units plus one spare unit, so that the 64 bit
+ * windows used by generic_extract_bits() never run past the buffer.
+ */
+void *llsim_malloc_aligned(int len)
+{
+	void *p;
+
+	len = (len + 2 * LLSIM_MEM_ALIGN - 1) & ~(LLSIM_MEM_ALIGN - 1);
+	llsim_assert(posix_memalign(&p, LLSIM_MEM_ALIGN, len) == 0, "out of memory");
+	memset(p, 0, len);
+	return p;
+}
+
 /*
  * unit registration functions
  */
@@ -26,7 +78,10 @@ llsim_unit_t *llsim_register_unit(char *name, void (*run) (struct llsim_unit_s *
 {
 	llsim_unit_t *unit;
 
+	// the last bit of the port masks is for accesses from outside a unit
+	llsim_assert(nr_units < LLSIM_MAX_UNITS - 1, "ERROR: too many units\n");
 	unit = (llsim_unit_t *) llsim_malloc(sizeof(llsim_unit_t));
+	unit->index = nr_units++;
 	unit->name = llsim_malloc(strlen(name)+1);
 	strcpy(unit->name, name);
 	unit->run = run;
@@ -57,8 +112,8 @@ llsim_unit_registers_t *llsim_allocate_registers(llsim_unit_t *unit, char *name,
 	ur->name = (char *) llsim_malloc(strlen(name)+1);
 	strcpy(ur->name, name);
 	ur->size = size;
-	ur->old = (void *) llsim_malloc(size);
-	ur->new = (void *) llsim_malloc(size);
+	ur->old = (void *) llsim_malloc_aligned(size);
+	ur->new = (void *) llsim_malloc_aligned(size);
 	ur->next = unit->regs;
 	unit->regs = ur;
 	return ur;
@@ -151,6 +206,232 @@ void llsim_register_input(char *unit_name, char *input_name, int bits, void *old
 	}
 }
 
+llsim_output_t *llsim_find_output(char *unit_name, char *output_name)
+{
+	llsim_unit_t *unit;
+	llsim_output_t *output;
+
+	unit = llsim_find_unit(unit_name);
+	llsim_assert(unit != NULL, "ERROR: couldn't find unit %s", unit_name);
+
+	output = unit->outputs;
+	while (output) {
+		if (strcmp(output_name, output->output_name) == 0)
+			break;
+		output = output->next;
+	}
+	llsim_assert(output != NULL, "ERROR: couldn't find output %s of unit %s", output_name, unit_name);
+	return output;
+}
+
+void llsim_register_param(char *unit_name, char *param_name, int *valp, int default_value)
+{
+	llsim_unit_t *unit;
+	llsim_param_t *param;
+	llsim_param_value_t *pv;
+	char full_name[256];
+
+	unit = llsim_find_unit(unit_name);
+	llsim_assert(unit != NULL, "ERROR: couldn't find unit %s", unit_name);
+
+	param = (llsim_param_t *) llsim_malloc(sizeof(llsim_param_t));
+	param->unit_name = (char *) llsim_malloc(strlen(unit_name)+1);
+	strcpy(param->unit_name, unit_name);
+	param->param_name = (char *) llsim_malloc(strlen(param_name)+1);
+	strcpy(param->param_name, param_name);
+	param->valp = valp;
+	param->next = unit->params;
+	unit->params = param;
+
+	*valp = default_value;
+	snprintf(full_name, sizeof(full_name), "%s.%s", unit_name, param_name);
+	for (pv = param_values; pv; pv = pv->next) {
+		if (strcmp(pv->name, full_name) == 0) {
+			*valp = pv->val;
+			pv->used = 1;
+		}
+	}
+	llsim_printf("llsim: param %s = %d\n", full_name, *valp);
+}
+
+/*
+ * a parameter of the simulator itself rather than of a unit, set with
+ * -p llsim.param_name=value
+ */
+int llsim_engine_param(char *param_name, int default_value)
+{
+	llsim_param_value_t *pv;
+	char full_name[256];
+	int val = default_value;
+
+	snprintf(full_name, sizeof(full_name), "llsim.%s", param_name);
+	for (pv = param_values; pv; pv = pv->next) {
+		if (strcmp(pv->name, full_name) == 0) {
+			val = pv->val;
+			pv->used = 1;
+		}
+	}
+	llsim_printf("llsim: param %s = %d\n", full_name, val);
+	return val;
+}
+
+/*
+ * the unit of a "unit.name", with *item pointing at the name after the dot
+ */
+static llsim_unit_t *llsim_find_dotted_unit(char *name, char **item)
+{
+	llsim_unit_t *unit;
+	char *dot;
+
+	dot = strchr(name, '.');
+	if (dot == NULL)
+		return NULL;
+	for (unit = llsim->units; unit; unit = unit->next)
+		if (strncmp(unit->name, name, dot - name) == 0 && unit->name[dot - name] == 0)
+			break;
+	*item = dot + 1;
+	return unit;
+}
+
+/*
+ * change a parameter at run time, name is unit.param
+ */
+void llsim_set_param(char *name, int val)
+{
+	llsim_unit_t *unit;
+	llsim_param_t *param;
+	char *item;
+
+	llsim_assert(strchr(name, '.') != NULL, "ERROR: bad parameter name %s\n", name);
+	unit = llsim_find_dotted_unit(name, &item);
+	for (param = unit ? unit->params : NULL; param; param = param->next) {
+		if (strcmp(param->param_name, item) == 0) {
+			*param->valp = val;
+			llsim_printf("llsim: clock %d: param %s = %d\n", llsim->clock, name, val);
+			return;
+		}
+	}
+	llsim_error("ERROR: unknown parameter %s\n", name);
+}
+
+void llsim_register_counter(char *unit_name, char *counter_name, i64 *valp)
+{
+	llsim_unit_t *unit;
+	llsim_counter_t *counter, *p;
+
+	unit = llsim_find_unit(unit_name);
+	llsim_assert(unit != NULL, "ERROR: couldn't find unit %s", unit_name);
+
+	counter = (llsim_counter_t *) llsim_malloc(sizeof(llsim_counter_t));
+	counter->unit_name = (char *) llsim_malloc(strlen(unit_name)+1);
+	strcpy(counter->unit_name, unit_name);
+	counter->counter_name = (char *) llsim_malloc(strlen(counter_name)+1);
+	strcpy(counter->counter_name, counter_name);
+	counter->valp = valp;
+	counter->next = NULL;
+	if (!unit->counters) {
+		unit->counters = counter;
+	} else {
+		p = unit->counters;
+		while (p->next)
+			p = p->next;
+		p->next = counter;
+	}
+}
+
+/*
+ * per bank counters of the banked memories, in the same format
+ */
+static void llsim_print_bank_counters(FILE *fp)
+{
+	llsim_unit_t *unit;
+	llsim_memory_t *mem;
+	llsim_mem_bank_t *bank;
+	int i;
+
+	for (unit = llsim->units; unit; unit = unit->next)
+		for (mem = unit->mems; mem; mem = mem->next) {
+			if (mem->banks == 1 && mem->read_latency == 1 && mem->write_latency == 1 && mem->bank_cycle == 1)
+				continue;
+			for (i = 0; i < mem->banks; i++) {
+				bank = &mem->bank[i];
+				fprintf(fp, "llsim: counter %s.%s_bank%d_accesses %lld\n", unit->name, mem->name, i, bank->accesses);
+				fprintf(fp, "llsim: counter %s.%s_bank%d_busy_cycles %lld\n", unit->name, mem->name, i, bank->busy_cycles);
+				fprintf(fp, "llsim: counter %s.%s_bank%d_stall_cycles %lld\n", unit->name, mem->name, i, bank->stall_cycles);
+				fprintf(fp, "llsim: counter %s.%s_bank%d_utilization_pct %lld\n", unit->name, mem->name, i,
+					llsim->clock ? 100 * bank->busy_cycles / llsim->clock : 0);
+			}
+		}
+}
+
+void llsim_print_counters(FILE *fp)
+{
+	llsim_unit_t *unit;
+	llsim_counter_t *counter;
+
+	unit = llsim->units;
+	while (unit) {
+		counter = unit->counters;
+		while (counter) {
+			fprintf(fp, "llsim: counter %s.%s %lld\n", counter->unit_name, counter->counter_name, *counter->valp);
+			counter = counter->next;
+		}
+		unit = unit->next;
+	}
+	llsim_print_bank_counters(fp);
+}
+
+/*
+ * registers and counters by "unit.name"
+ */
+llsim_register_t *llsim_find_register(char *name)
+{
+	llsim_unit_t *unit;
+	llsim_register_t *reg;
+	char *item;
+
+	unit = llsim_find_dotted_unit(name, &item);
+	if (unit == NULL)
+		return NULL;
+	for (reg = unit->registers; reg; reg = reg->next)
+		if (strcmp(reg->reg_name, item) == 0)
+			return reg;
+	return NULL;
+}
+
+i64 *llsim_find_counter(char *name)
+{
+	llsim_unit_t *unit;
+	llsim_counter_t *counter;
+	char *item;
+
+	unit = llsim_find_dotted_unit(name, &item);
+	if (unit == NULL)
+		return NULL;
+	for (counter = unit->counters; counter; counter = counter->next)
+		if (strcmp(counter->counter_name, item) == 0)
+			return counter->valp;
+	return NULL;
+}
+
+/*
+ * value of a parameter, name is unit.param
+ */
+int *llsim_find_param(char *name)
+{
+	llsim_unit_t *unit;
+	llsim_param_t *param;
+	char *item;
+
+	unit = llsim_find_dotted_unit(name, &item);
+	if (unit == NULL)
+		return NULL;
+	for (param = unit->params; param; param = param->next)
+		if (strcmp(param->param_name, item) == 0)
+			return param->valp;
+	return NULL;
+}
+
 int generic_extract_bits(char *p, int msb, int lsb)
 {
 	int byte_pos;
@@ -176,31 +457,228 @@ void generic_inject_bits(char *p, int data, int msb, int lsb)
 /*
  * memories
  */
-llsim_memory_t *llsim_allocate_memory(llsim_unit_t *unit, char *name, int bits, int height, int dp)
+typedef int llsim_v4si __attribute__ ((vector_size (16)));
+
+static llsim_memory_t *llsim_new_memory(llsim_unit_t *unit, char *name, int bits, int height, int dp)
 {
 	llsim_memory_t *mem;
 
-	llsim_assert(bits <= 32, "ERROR: bits %d not supported", bits);
+	llsim_assert(bits > 0 && bits <= LLSIM_MEM_MAX_BITS, "ERROR: bits %d not supported", bits);
 	mem = (llsim_memory_t *) llsim_malloc(sizeof(llsim_memory_t));
 	mem->entry_size = (bits + 31) / 32;
+	mem->stride = 1;
+	while (mem->stride < mem->entry_size)
+		mem->stride <<= 1;
 	mem->name = (char *) llsim_malloc(strlen(name)+1);
 	strcpy(mem->name, name);
 	mem->bits = bits;
 	mem->height = height;
 	mem->dp = dp;
-	mem->data = (int *) llsim_malloc(height * mem->entry_size * sizeof(int));
-	mem->datain = (int *) llsim_malloc(mem->entry_size);
-	mem->dataout = (int *) llsim_malloc(mem->entry_size);
+	mem->datain = (int *) llsim_malloc_aligned(mem->stride * sizeof(int));
+	mem->dataout = (int *) llsim_malloc_aligned(mem->stride * sizeof(int));
+	mem->writemask = (int *) llsim_malloc_aligned(mem->stride * sizeof(int));
+	mem->pending_data = (int *) llsim_malloc_aligned(LLSIM_MEM_MAX_LATENCY * mem->stride * sizeof(int));
+	mem->read_latency = 1;
+	mem->write_latency = 1;
+	mem->bank_cycle = 1;
+	mem->banks = 1;
 	mem->next = unit->mems;
 	unit->mems = mem;
 	return mem;
 }
 
+llsim_memory_t *llsim_allocate_memory(llsim_unit_t *unit, char *name, int bits, int height, int dp)
+{
+	llsim_memory_t *mem;
+
+	mem = llsim_new_memory(unit, name, bits, height, dp);
+	mem->data = (int *) llsim_malloc_aligned(height * mem->stride * sizeof(int));
+	return mem;
+}
+
+static llsim_mem_page_t *zero_page = NULL;
+
+static llsim_mem_page_t *llsim_alloc_page(void)
+{
+	return (llsim_mem_page_t *) llsim_malloc_aligned(sizeof(llsim_mem_page_t) + LLSIM_MEM_PAGE_SIZE);
+}
+
+llsim_memory_t *llsim_allocate_paged_memory(llsim_unit_t *unit, char *name, int bits, int height, int dp)
+{
+	llsim_memory_t *mem;
+	int i;
+
+	if (zero_page == NULL)
+		zero_page = llsim_alloc_page();
+
+	mem = llsim_new_memory(unit, name, bits, height, dp);
+	mem->page_shift = 0;
+	while ((mem->stride * sizeof(int)) << (mem->page_shift + 1) <= LLSIM_MEM_PAGE_SIZE)
+		mem->page_shift++;
+	mem->nr_pages = (height + (1 << mem->page_shift) - 1) >> mem->page_shift;
+	mem->pages = (llsim_mem_page_t **) llsim_malloc(mem->nr_pages * sizeof(llsim_mem_page_t *));
+	for (i = 0; i < mem->nr_pages; i++)
+		mem->pages[i] = zero_page;
+	return mem;
+}
+
+static void llsim_put_page(llsim_mem_page_t *page)
+{
+	if (page == zero_page)
+		return;
+	if (--page->refs == 0)
+		free(page);
+}
+
+/*
+ * give dst a copy-on-write view of all of src's pages
+ */
+void llsim_mem_share(llsim_memory_t *dst, llsim_memory_t *src)
+{
+	int i;
+
+	llsim_assert(dst->pages && src->pages && dst->nr_pages == src->nr_pages && dst->stride == src->stride,
+		     "ERROR: can't share memory %s with memory %s", src->name, dst->name);
+	for (i = 0; i < dst->nr_pages; i++) {
+		if (src->pages[i] != zero_page)
+			src->pages[i]->refs++;
+		llsim_put_page(dst->pages[i]);
+		dst->pages[i] = src->pages[i];
+	}
+}
+
+llsim_device_t *llsim_mem_map_device(llsim_memory_t *memory, char *name, unsigned int base, unsigned int size,
+				     int (*read)(llsim_device_t *dev, unsigned int offset),
+				     void (*write)(llsim_device_t *dev, unsigned int offset, int val), void *private)
+{
+	llsim_device_t *dev;
+
+	llsim_assert(memory->entry_size == 1, "ERROR: device %s on %d bit memory %s\n", name, memory->bits, memory->name);
+	llsim_assert(size > 0 && base + size - 1 >= base, "ERROR: device %s: bad address range\n", name);
+	for (dev = memory->devices; dev; dev = dev->next)
+		llsim_assert(base + size <= dev->base || dev->base + dev->size <= base,
+			     "ERROR: device %s overlaps device %s on memory %s\n", name, dev->name, memory->name);
+	dev = (llsim_device_t *) llsim_malloc(sizeof(llsim_device_t));
+	dev->name = strdup(name);
+	dev->base = base;
+	dev->size = size;
+	dev->read = read;
+	dev->write = write;
+	dev->private = private;
+	dev->next = memory->devices;
+	memory->devices = dev;
+	return dev;
+}
+
+/*
+ * device mapped at addr, NULL for the storage
+ */
+static inline llsim_device_t *llsim_mem_device(llsim_memory_t *memory, int addr)
+{
+	llsim_device_t *dev;
+
+	for (dev = memory->devices; dev; dev = dev->next)
+		if ((unsigned int) addr - dev->base < dev->size)
+			return dev;
+	return NULL;
+}
+
+llsim_memory_t *llsim_find_memory(char *unit_name, char *name)
+{
+	llsim_unit_t *unit;
+	llsim_memory_t *mem;
+
+	unit = llsim_find_unit(unit_name);
+	llsim_assert(unit != NULL, "ERROR: couldn't find unit %s", unit_name);
+
+	mem = unit->mems;
+	while (mem) {
+		if (strcmp(name, mem->name) == 0)
+			break;
+		mem = mem->next;
+	}
+	llsim_assert(mem != NULL, "ERROR: couldn't find memory %s of unit %s", name, unit_name);
+	return mem;
+}
+
+static inline int *llsim_mem_entry(llsim_memory_t *memory, int addr)
+{
+	if (!memory->pages)
+		return memory->data + addr * memory->stride;
+	return memory->pages[addr >> memory->page_shift]->data +
+		(addr & ((1 << memory->page_shift) - 1)) * memory->stride;
+}
+
+/*
+ * entry about to be written, unshares / allocates its page
+ */
+static int *llsim_mem_entry_w(llsim_memory_t *memory, int addr)
+{
+	llsim_mem_page_t *page, *new_page;
+
+	if (!memory->pages)
+		return memory->data + addr * memory->stride;
+	page = memory->pages[addr >> memory->page_shift];
+	if (page == zero_page || page->refs > 1) {
+		new_page = llsim_alloc_page();
+		if (page != zero_page)
+			memcpy(new_page->data, page->data, LLSIM_MEM_PAGE_SIZE);
+		new_page->refs = 1;
+		llsim_put_page(page);
+		memory->pages[addr >> memory->page_shift] = new_page;
+		memory->pages_allocated++;
+	}
+	return llsim_mem_entry(memory, addr);
+}
+
+/*
+ * whole entry copy / masked merge. a stride of 4 words or more is a multiple
+ * of the vector width and aligned, so those entries move 128 bits at a time.
+ */
+static inline void llsim_mem_copy_entry(llsim_memory_t *memory, int *dst, const int *src)
+{
+	llsim_v4si *d, *s;
+	int i;
+
+	if (memory->stride < 4) {
+		for (i = 0; i < memory->stride; i++)
+			dst[i] = src[i];
+		return;
+	}
+	d = (llsim_v4si *) __builtin_assume_aligned(dst, 16);
+	s = (llsim_v4si *) __builtin_assume_aligned(src, 16);
+	for (i = 0; i < memory->stride / 4; i++)
+		d[i] = s[i];
+}
+
+static inline void llsim_mem_merge_entry(llsim_memory_t *memory, int *dst, const int *src, const int *mask)
+{
+	llsim_v4si *d, *s, *m;
+	int i;
+
+	if (memory->stride < 4) {
+		for (i = 0; i < memory->stride; i++)
+			dst[i] = (dst[i] & ~mask[i]) | (src[i] & mask[i]);
+		return;
+	}
+	d = (llsim_v4si *) __builtin_assume_aligned(dst, 16);
+	s = (llsim_v4si *) __builtin_assume_aligned(src, 16);
+	m = (llsim_v4si *) __builtin_assume_aligned(mask, 16);
+	for (i = 0; i < memory->stride / 4; i++)
+		d[i] = (d[i] & ~m[i]) | (s[i] & m[i]);
+}
+
+static void llsim_mem_check_field(llsim_memory_t *memory, int msb, int lsb)
+{
+	llsim_assert(msb < memory->bits && lsb <= msb && msb - lsb < 32,
+		     "ERROR: field [%d:%d] out of range for %d bit memory %s", msb, lsb, memory->bits, memory->name);
+}
+
 void llsim_mem_inject(llsim_memory_t *memory, int addr, int val, int msb, int lsb)
 {
 	int *p;
 
-	p = memory->data + addr * memory->entry_size;
+	p = llsim_mem_entry_w(memory, addr);
 	generic_inject_bits((char *) p, val, msb, lsb);
 }
 
@@ -208,76 +686,463 @@ int llsim_mem_extract(llsim_memory_t *memory, int addr, int msb, int lsb)
 {
 	int *p;
 
-	p = memory->data + addr * memory->entry_size;
+	p = llsim_mem_entry(memory, addr);
 	return generic_extract_bits((char *) p,msb,lsb);
 }
 
+void llsim_mem_inject_entry(llsim_memory_t *memory, int addr, const int *val)
+{
+	memcpy(llsim_mem_entry_w(memory, addr), val, memory->entry_size * sizeof(int));
+}
+
+void llsim_mem_extract_entry(llsim_memory_t *memory, int addr, int *val)
+{
+	memcpy(val, llsim_mem_entry(memory, addr), memory->entry_size * sizeof(int));
+}
+
+/*
+ * the port masks are set atomically, units may run in parallel. a unit
+ * using a port twice in a clock fails at once, two units using it in the
+ * same clock is reported by llsim_mem_clock()
+ */
+static inline unsigned long long llsim_port_bit(void)
+{
+	return 1ull << (llsim_current_unit ? llsim_current_unit->index : LLSIM_MAX_UNITS - 1);
+}
+
 void llsim_mem_write(llsim_memory_t *memory, int addr)
 {
-	llsim_assert(!memory->write, "ERROR: multiple memory writes to memory %s", memory->name);
+	unsigned long long bit = llsim_port_bit();
+
+	llsim_assert(!(__atomic_fetch_or(&memory->write_units, bit, __ATOMIC_RELAXED) & bit),
+		     "ERROR: multiple memory writes to memory %s", memory->name);
 	memory->write = 1;
 	memory->write_addr = addr;
+	memory->write_masked = 0;
+}
+
+/*
+ * write only the bits set in mask (entry_size words) of datain
+ */
+void llsim_mem_write_masked(llsim_memory_t *memory, int addr, const int *mask)
+{
+	llsim_mem_write(memory, addr);
+	memcpy(memory->writemask, mask, memory->entry_size * sizeof(int));
+	memory->write_masked = 1;
 }
 
 void llsim_mem_read(llsim_memory_t *memory, int addr)
 {
-	llsim_assert(!memory->read, "ERROR: multiple memory reads to memory %s", memory->name);
+	llsim_mem_read_tag(memory, addr, 0);
+}
+
+void llsim_mem_read_tag(llsim_memory_t *memory, int addr, int tag)
+{
+	unsigned long long bit = llsim_port_bit();
+
+	llsim_assert(!(__atomic_fetch_or(&memory->read_units, bit, __ATOMIC_RELAXED) & bit),
+		     "ERROR: multiple memory reads to memory %s", memory->name);
 	memory->read = 1;
 	memory->read_addr = addr;
+	memory->read_tag = tag;
+}
+
+static llsim_mem_bank_t *llsim_mem_bank(llsim_memory_t *memory, int addr)
+{
+	return &memory->bank[(unsigned int) addr % memory->banks];
+}
+
+/*
+ * 1 if an access to addr may be issued this clock. a 0 is counted as a
+ * stall cycle of the bank, so call it once per clock per waiting request
+ */
+int llsim_mem_ready(llsim_memory_t *memory, int addr)
+{
+	llsim_mem_bank_t *bank = llsim_mem_bank(memory, addr);
+
+	if (bank->busy_until <= llsim->clock)
+		return 1;
+	__atomic_fetch_add(&bank->stall_cycles, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * 1 if dataout holds the data of a read issued with tag during this clock
+ */
+int llsim_mem_valid(llsim_memory_t *memory, int tag)
+{
+	return memory->valid && memory->valid_tag == tag;
+}
+
+/*
+ * make the timing of a memory parameters of unit_name: <mem>_read_latency,
+ * <mem>_write_latency, <mem>_bank_cycle and <mem>_banks. all but the number
+ * of banks may also be changed while running, e.g. by a sweep
+ */
+void llsim_mem_register_timing(llsim_memory_t *memory, char *unit_name)
+{
+	char name[128];
+
+	snprintf(name, sizeof(name), "%s_read_latency", memory->name);
+	llsim_register_param(unit_name, name, &memory->read_latency, 1);
+	snprintf(name, sizeof(name), "%s_write_latency", memory->name);
+	llsim_register_param(unit_name, name, &memory->write_latency, 1);
+	snprintf(name, sizeof(name), "%s_bank_cycle", memory->name);
+	llsim_register_param(unit_name, name, &memory->bank_cycle, 1);
+	snprintf(name, sizeof(name), "%s_banks", memory->name);
+	llsim_register_param(unit_name, name, &memory->banks, 1);
+	llsim_assert(memory->banks >= 1 && memory->banks <= LLSIM_MEM_MAX_BANKS,
+		     "ERROR: memory %s: %d banks not supported\n", memory->name, memory->banks);
+}
+
+static void llsim_mem_occupy(llsim_memory_t *mem, int addr, int cycles)
+{
+	llsim_mem_bank_t *bank = llsim_mem_bank(mem, addr);
+
+	llsim_assert(bank->busy_until <= llsim->clock, "ERROR: clock %d: access to busy bank %d of memory %s\n",
+		     llsim->clock, (unsigned int) addr % mem->banks, mem->name);
+	bank->busy_until = llsim->clock + cycles;
+	bank->accesses++;
+	bank->busy_cycles += cycles;
 }
 
 void llsim_mem_set_datain(llsim_memory_t *memory, int val, int msb, int lsb)
 {
-	int *p;
+	llsim_mem_check_field(memory, msb, lsb);
+	generic_inject_bits((char *) memory->datain, val, msb, lsb);
+}
 
-	llsim_assert(msb <= 31 && lsb <= 31, "ERROR only <=32 bit memories supported");
-	p = (int *) memory->datain;
-	*p = rbs(*p,val,msb,lsb);
+void llsim_mem_set_datain_entry(llsim_memory_t *memory, const int *val)
+{
+	memcpy(memory->datain, val, memory->entry_size * sizeof(int));
 }
 
 int llsim_mem_extract_dataout(llsim_memory_t *memory, int msb, int lsb)
 {
+	llsim_mem_check_field(memory, msb, lsb);
+	return generic_extract_bits((char *) memory->dataout, msb, lsb);
+}
+
+void llsim_mem_extract_dataout_entry(llsim_memory_t *memory, int *val)
+{
+	memcpy(val, memory->dataout, memory->entry_size * sizeof(int));
+}
+
+/*
+ * one entry per line, most significant word first. untouched pages of a
+ * paged memory are written as a block.
+ */
+static char *llsim_mem_format_entry(char *p, int *entry, int entry_size)
+{
+	static const char hex[] = "0123456789abcdef";
+	int i, j;
+
+	for (i = entry_size - 1; i >= 0; i--)
+		for (j = 28; j >= 0; j -= 4)
+			*p++ = hex[(entry[i] >> j) & 0xf];
+	*p++ = '\n';
+	return p;
+}
+
+void llsim_mem_dump_hex(llsim_memory_t *memory, FILE *fp, int height)
+{
+	char *buf, *p, *zeros;
+	int line_size, page_entries, addr, n, i;
+
+	line_size = memory->entry_size * 8 + 1;
+	page_entries = memory->pages ? (1 << memory->page_shift) : 1024;
+	buf = (char *) llsim_malloc(page_entries * line_size);
+	zeros = NULL;
+	if (memory->pages) {
+		zeros = (char *) llsim_malloc(page_entries * line_size);
+		p = zeros;
+		for (i = 0; i < page_entries; i++)
+			p = llsim_mem_format_entry(p, zero_page->data, memory->entry_size);
+	}
+
+	for (addr = 0; addr < height; addr += page_entries) {
+		n = height - addr < page_entries ? height - addr : page_entries;
+		if (memory->pages && memory->pages[addr >> memory->page_shift] == zero_page) {
+			fwrite(zeros, line_size, n, fp);
+			continue;
+		}
+		p = buf;
+		for (i = 0; i < n; i++)
+			p = llsim_mem_format_entry(p, llsim_mem_entry(memory, addr + i), memory->entry_size);
+		fwrite(buf, 1, p - buf, fp);
+	}
+	free(buf);
+	free(zeros);
+}
+
+static void llsim_mem_print_entry(const int *p, int entry_size)
+{
+	int i;
+
+	for (i = entry_size - 1; i >= 0; i--)
+		llsim_printf("%08x", p[i]);
+}
+
+/*
+ * default observer, the READ / WRITE prints of the traced clocks
+ */
+static void llsim_print_mem_event(const llsim_event_t *ev, void *arg)
+{
+	if (!llsim->trace)
+		return;
+	if (ev->type == LLSIM_EV_MEM_READ) {
+		llsim_printf("llsim: clock %d: READ MEM %s addr %d --> ", ev->clock, ev->mem->name, ev->a);
+		llsim_mem_print_entry(ev->entry, ev->mem->entry_size);
+		llsim_printf("\n");
+	} else {
+		llsim_printf("llsim: clock %d: WRITE ", ev->clock);
+		llsim_mem_print_entry(ev->entry, ev->mem->entry_size);
+		llsim_printf(" --> MEM %s addr %d\n", ev->mem->name, ev->a);
+	}
+}
+
+static int llsim_cmp_names(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/*
+ * more than one unit used a port of mem. the units are listed sorted by
+ * name, so the report doesn't depend on the order they ran in
+ */
+static void llsim_mem_port_conflict(llsim_memory_t *mem, char *access, unsigned long long units)
+{
+	llsim_unit_t *unit;
+	char *names[LLSIM_MAX_UNITS], list[1024];
+	int n = 0, i, len = 0;
+
+	for (unit = llsim->units; unit; unit = unit->next)
+		if ((units >> unit->index) & 1)
+			names[n++] = unit->name;
+	if ((units >> (LLSIM_MAX_UNITS - 1)) & 1)
+		names[n++] = "llsim";
+	qsort(names, n, sizeof(char *), llsim_cmp_names);
+	list[0] = 0;
+	for (i = 0; i < n; i++)
+		len += snprintf(list + len, sizeof(list) - len, "%s%s", i ? ", " : "", names[i]);
+	llsim_error("ERROR: clock %d: multiple memory %ss to memory %s by %s\n", llsim->clock, access, mem->name, list);
+}
+
+static void llsim_mem_clock(llsim_memory_t *mem)
+{
+	llsim_device_t *dev;
+	int read_done, write_done, i, slot, val;
 	int *p;
 
-	llsim_assert(msb <= 31 && lsb <= 31, "ERROR only <=32 bit memories supported");
-	p = (int *) memory->dataout;
-	return sbs(*p,msb,lsb);
+	if (mem->read_units & (mem->read_units - 1))
+		llsim_mem_port_conflict(mem, "read", mem->read_units);
+	if (mem->write_units & (mem->write_units - 1))
+		llsim_mem_port_conflict(mem, "write", mem->write_units);
+	mem->read_units = 0;
+	mem->write_units = 0;
+
+	read_done = mem->read;
+	write_done = mem->write;
+	if (mem->read) {
+		dev = llsim_mem_device(mem, mem->read_addr);
+		llsim_assert(dev || (unsigned int) mem->read_addr < mem->height, "mem %s read address %d out of range\n", mem->name, mem->read_addr);
+		llsim_assert(mem->read_latency >= 1 && mem->read_latency < LLSIM_MEM_MAX_LATENCY,
+			     "ERROR: memory %s: read latency %d not supported\n", mem->name, mem->read_latency);
+		if (!dev && mem->watch_r && (mem->watch_r[mem->read_addr / 32] >> (mem->read_addr % 32)) & 1)
+			llsim_bp_hit("watchpoint read %s addr %d", mem->name, mem->read_addr);
+		llsim_mem_occupy(mem, mem->read_addr, mem->bank_cycle);
+		slot = (llsim->clock + mem->read_latency) % LLSIM_MEM_MAX_LATENCY;
+		llsim_assert(!mem->pending[slot], "ERROR: clock %d: two reads from memory %s complete together\n", llsim->clock, mem->name);
+		p = mem->pending_data + slot * mem->stride;
+		if (dev)
+			p[0] = dev->read(dev, mem->read_addr - dev->base);
+		else
+			llsim_mem_copy_entry(mem, p, llsim_mem_entry(mem, mem->read_addr));
+		mem->pending[slot] = 1;
+		mem->pending_tag[slot] = mem->read_tag;
+		if (llsim_observing(LLSIM_EV_MEM_READ))
+			llsim_event_post(LLSIM_EV_MEM_READ, mem, NULL, mem->read_addr, p[0], p);
+		mem->read = 0;
+	}
+	if (mem->write) {
+		dev = llsim_mem_device(mem, mem->write_addr);
+		llsim_assert(dev || (unsigned int) mem->write_addr < mem->height, "mem %s write address %d out of range\n", mem->name, mem->write_addr);
+		if (!dev && mem->watch_w && (mem->watch_w[mem->write_addr / 32] >> (mem->write_addr % 32)) & 1)
+			llsim_bp_hit("watchpoint write %s addr %d", mem->name, mem->write_addr);
+		llsim_mem_occupy(mem, mem->write_addr, mem->write_latency);
+		if (dev) {
+			val = mem->datain[0];
+			if (mem->write_masked)
+				val = (dev->read(dev, mem->write_addr - dev->base) & ~mem->writemask[0]) | (val & mem->writemask[0]);
+			dev->write(dev, mem->write_addr - dev->base, val);
+		} else {
+			p = llsim_mem_entry_w(mem, mem->write_addr);
+			if (mem->write_masked)
+				llsim_mem_merge_entry(mem, p, mem->datain, mem->writemask);
+			else
+				llsim_mem_copy_entry(mem, p, mem->datain);
+		}
+		if (llsim_observing(LLSIM_EV_MEM_WRITE))
+			llsim_event_post(LLSIM_EV_MEM_WRITE, mem, NULL, mem->write_addr, mem->datain[0], mem->datain);
+		mem->write = 0;
+	}
+	llsim_assert(!(read_done && write_done), "ERROR: simultaneous access to memory %s", mem->name);
+
+	/*
+	 * deliver the read due next clock
+	 */
+	slot = (llsim->clock + 1) % LLSIM_MEM_MAX_LATENCY;
+	mem->valid = mem->pending[slot];
+	if (mem->valid) {
+		llsim_mem_copy_entry(mem, mem->dataout, mem->pending_data + slot * mem->stride);
+		mem->valid_tag = mem->pending_tag[slot];
+		mem->pending[slot] = 0;
+	} else if (!write_done)
+		for (i = 0; i < mem->entry_size; i++)
+			mem->dataout[i] = 0xBAADBAAD;
+}
+
+void llsim_run_unit(llsim_unit_t *unit)
+{
+	llsim_current_unit = unit;
+	unit->run(unit);
+}
+
+#ifdef LLSIM_STATIC
+/*
+ * static build
+ *
+ * the topology is fixed at compile time by sp_topology.h. once the units
+ * registered, llsim_static_init() checks them against it and resolves the
+ * memories and register blocks into arrays. every clock then calls the run
+ * functions by name and clocks the memories without walking any list, so
+ * with link time optimization the whole clock compiles into one function.
+ */
+#define LLSIM_UNIT(u, fn)		void fn(llsim_unit_t *unit);
+#define LLSIM_MEMORY(u, m)
+#include "sp_topology.h"
+#undef LLSIM_UNIT
+#undef LLSIM_MEMORY
+
+enum {
+#define LLSIM_UNIT(u, fn)		LLSIM_STATIC_UNIT_##u,
+#define LLSIM_MEMORY(u, m)
+#include "sp_topology.h"
+#undef LLSIM_UNIT
+#undef LLSIM_MEMORY
+	LLSIM_STATIC_UNITS
+};
+
+enum {
+#define LLSIM_UNIT(u, fn)
+#define LLSIM_MEMORY(u, m)		LLSIM_STATIC_MEM_##u##_##m,
+#include "sp_topology.h"
+#undef LLSIM_UNIT
+#undef LLSIM_MEMORY
+	LLSIM_STATIC_MEMS
+};
+
+static llsim_unit_t *static_units[LLSIM_STATIC_UNITS];
+static llsim_memory_t *static_mems[LLSIM_STATIC_MEMS];
+static llsim_unit_registers_t *static_regs[LLSIM_MAX_UNITS];
+static int static_nr_regs = 0;
+
+static void llsim_static_init(void)
+{
+	llsim_unit_t *unit = llsim->units;
+	llsim_unit_registers_t *ur;
+	llsim_memory_t *mem;
+	int n = 0, nr_mems = 0;
+
+#define LLSIM_UNIT(u, fn)								\
+	llsim_assert(unit && strcmp(unit->name, #u) == 0 && unit->run == fn,	\
+		     "ERROR: unit %s is not unit %d of sp_topology.h\n", unit ? unit->name : "(none)", n); \
+	static_units[n++] = unit;							\
+	unit = unit->next;
+#define LLSIM_MEMORY(u, m)
+#include "sp_topology.h"
+#undef LLSIM_UNIT
+#undef LLSIM_MEMORY
+	llsim_assert(unit == NULL, "ERROR: unit %s is not in sp_topology.h\n", unit->name);
+
+	n = 0;
+#define LLSIM_UNIT(u, fn)
+#define LLSIM_MEMORY(u, m)		static_mems[n++] = llsim_find_memory(#u, #m);
+#include "sp_topology.h"
+#undef LLSIM_UNIT
+#undef LLSIM_MEMORY
+
+	for (unit = llsim->units; unit; unit = unit->next) {
+		for (mem = unit->mems; mem; mem = mem->next)
+			nr_mems++;
+		for (ur = unit->regs; ur; ur = ur->next) {
+			llsim_assert(static_nr_regs < LLSIM_MAX_UNITS, "ERROR: too many register blocks\n");
+			static_regs[static_nr_regs++] = ur;
+		}
+	}
+	llsim_assert(nr_mems == LLSIM_STATIC_MEMS, "ERROR: %d memories, sp_topology.h has %d\n", nr_mems, LLSIM_STATIC_MEMS);
+}
+
+static inline void llsim_run_clock_static(void)
+{
+	llsim_unit_registers_t *ur;
+	int n = 0, i;
+
+#define LLSIM_UNIT(u, fn)		llsim_current_unit = static_units[n++]; fn(llsim_current_unit);
+#define LLSIM_MEMORY(u, m)
+#include "sp_topology.h"
+#undef LLSIM_UNIT
+#undef LLSIM_MEMORY
+	llsim_current_unit = NULL;
+
+	for (i = 0; i < LLSIM_STATIC_MEMS; i++)
+		llsim_mem_clock(static_mems[i]);
+
+	for (i = 0; i < static_nr_regs; i++) {
+		ur = static_regs[i];
+		memcpy(ur->old, ur->new, ur->size);
+	}
 }
+#endif
 
 void llsim_run_clock(void)
 {
 	llsim_unit_t *unit;
 	llsim_unit_registers_t *ur;
 	llsim_memory_t *mem;
-	int read_done, write_done;
-	
+
+#ifdef LLSIM_STATIC
+	if (!llsim_par_enabled()) {
+		llsim_run_clock_static();
+		return;
+	}
+#endif
+
 	/*
-	 * run units
+	 * run units. they only read old registers, so they may run in parallel
+	 */
+	if (llsim_par_enabled()) {
+		llsim_par_run_units();
+	} else {
+		unit = llsim->units;
+		while (unit) {
+			llsim_run_unit(unit);
+			unit = unit->next;
+		}
+	}
+	llsim_current_unit = NULL;
+	if (llsim_observed && llsim_par_enabled())
+		llsim_event_deliver_units();
+
+	/*
+	 * memories. done after all units ran, so a unit may access a memory
+	 * owned by another unit
 	 */
 	unit = llsim->units;
 	while (unit) {
-		unit->run(unit);
-
-		// memories
 		mem = unit->mems;
 		while (mem) {
-			read_done = mem->read;
-			write_done = mem->write;
-			if (mem->read) {
-				llsim_assert(mem->read_addr < mem->height, "mem %s read address %d out of range\n", mem->name, mem->read_addr);
-				*mem->dataout = mem->data[mem->read_addr];
-				llsim_printf("llsim: clock %d: READ MEM %s addr %d --> %08x\n", llsim->clock, mem->name, mem->read_addr, *mem->dataout);
-				mem->read = 0;
-			}
-			if (mem->write) {
-				llsim_assert(mem->write_addr < mem->height, "mem %s write address %d out of range\n", mem->name, mem->write_addr);
-				mem->data[mem->write_addr] = *mem->datain;
-				llsim_printf("llsim: clock %d: WRITE %08x --> MEM %s addr %d\n", llsim->clock, *mem->datain, mem->name, mem->write_addr);
-				mem->write = 0;
-			}
-			llsim_assert(!(read_done && write_done), "ERROR: simultaneous access to memory %s", mem->name);
-			if (!read_done && !write_done)
-				*mem->dataout = 0xBAADBAAD;
+			llsim_mem_clock(mem);
 			mem = mem->next;
 		}
 		unit = unit->next;
@@ -297,6 +1162,139 @@ void llsim_run_clock(void)
 	}
 }
 
+/*
+ * snapshots
+ */
+typedef struct llsim_mem_snapshot_s {
+	llsim_memory_t *mem;
+	llsim_memory_t state;		// ports, timing, banks and reads in flight
+	int *dataout;			// copies of the buffers state points to
+	int *pending_data;
+	llsim_mem_page_t **pages;	// paged memories, a reference to every page
+	int *data;			// other memories, a copy of the data
+} llsim_mem_snapshot_t;
+
+struct llsim_snapshot_s {
+	int clock;
+	int stop_sim;
+	int nr_regs;
+	llsim_unit_registers_t **regs;
+	void **regs_old;
+	void **regs_new;
+	int nr_mems;
+	llsim_mem_snapshot_t *mems;
+	int nr_counters;
+	i64 **counters;
+	i64 *counter_vals;
+};
+
+llsim_snapshot_t *llsim_snapshot_take(void)
+{
+	llsim_snapshot_t *snap;
+	llsim_unit_t *unit;
+	llsim_unit_registers_t *ur;
+	llsim_memory_t *mem;
+	llsim_mem_snapshot_t *ms;
+	llsim_counter_t *counter;
+	int i, n;
+
+	snap = (llsim_snapshot_t *) llsim_malloc(sizeof(llsim_snapshot_t));
+	for (unit = llsim->units; unit; unit = unit->next) {
+		for (ur = unit->regs; ur; ur = ur->next)
+			snap->nr_regs++;
+		for (mem = unit->mems; mem; mem = mem->next)
+			snap->nr_mems++;
+		for (counter = unit->counters; counter; counter = counter->next)
+			snap->nr_counters++;
+	}
+	snap->regs = (llsim_unit_registers_t **) llsim_malloc(snap->nr_regs * sizeof(llsim_unit_registers_t *));
+	snap->regs_old = (void **) llsim_malloc(snap->nr_regs * sizeof(void *));
+	snap->regs_new = (void **) llsim_malloc(snap->nr_regs * sizeof(void *));
+	snap->mems = (llsim_mem_snapshot_t *) llsim_malloc(snap->nr_mems * sizeof(llsim_mem_snapshot_t));
+	snap->counters = (i64 **) llsim_malloc(snap->nr_counters * sizeof(i64 *));
+	snap->counter_vals = (i64 *) llsim_malloc(snap->nr_counters * sizeof(i64));
+
+	snap->clock = llsim->clock;
+	snap->stop_sim = stop_sim;
+	snap->nr_regs = snap->nr_mems = snap->nr_counters = 0;
+	for (unit = llsim->units; unit; unit = unit->next) {
+		for (ur = unit->regs; ur; ur = ur->next) {
+			n = snap->nr_regs++;
+			snap->regs[n] = ur;
+			snap->regs_old[n] = llsim_malloc(ur->size);
+			snap->regs_new[n] = llsim_malloc(ur->size);
+			memcpy(snap->regs_old[n], ur->old, ur->size);
+			memcpy(snap->regs_new[n], ur->new, ur->size);
+		}
+		for (mem = unit->mems; mem; mem = mem->next) {
+			ms = &snap->mems[snap->nr_mems++];
+			ms->mem = mem;
+			ms->state = *mem;
+			ms->dataout = (int *) llsim_malloc_aligned(mem->stride * sizeof(int));
+			memcpy(ms->dataout, mem->dataout, mem->stride * sizeof(int));
+			ms->pending_data = (int *) llsim_malloc_aligned(LLSIM_MEM_MAX_LATENCY * mem->stride * sizeof(int));
+			memcpy(ms->pending_data, mem->pending_data, LLSIM_MEM_MAX_LATENCY * mem->stride * sizeof(int));
+			if (mem->pages) {
+				ms->pages = (llsim_mem_page_t **) llsim_malloc(mem->nr_pages * sizeof(llsim_mem_page_t *));
+				for (i = 0; i < mem->nr_pages; i++) {
+					ms->pages[i] = mem->pages[i];
+					if (mem->pages[i] != zero_page)
+						mem->pages[i]->refs++;
+				}
+			} else {
+				ms->data = (int *) llsim_malloc_aligned(mem->height * mem->stride * sizeof(int));
+				memcpy(ms->data, mem->data, mem->height * mem->stride * sizeof(int));
+			}
+		}
+		for (counter = unit->counters; counter; counter = counter->next) {
+			n = snap->nr_counters++;
+			snap->counters[n] = counter->valp;
+			snap->counter_vals[n] = *counter->valp;
+		}
+	}
+	return snap;
+}
+
+/*
+ * a page still shared with the snapshot was not written since, only the
+ * others are put back
+ */
+void llsim_snapshot_restore(llsim_snapshot_t *snap)
+{
+	llsim_memory_t *mem;
+	llsim_mem_snapshot_t *ms;
+	llsim_mem_page_t **pages;
+	int i;
+
+	llsim->clock = snap->clock;
+	stop_sim = snap->stop_sim;
+	for (i = 0; i < snap->nr_regs; i++) {
+		memcpy(snap->regs[i]->old, snap->regs_old[i], snap->regs[i]->size);
+		memcpy(snap->regs[i]->new, snap->regs_new[i], snap->regs[i]->size);
+	}
+	for (ms = snap->mems; ms < snap->mems + snap->nr_mems; ms++) {
+		mem = ms->mem;
+		pages = mem->pages;
+		*mem = ms->state;
+		memcpy(mem->dataout, ms->dataout, mem->stride * sizeof(int));
+		memcpy(mem->pending_data, ms->pending_data, LLSIM_MEM_MAX_LATENCY * mem->stride * sizeof(int));
+		if (!pages) {
+			memcpy(mem->data, ms->data, mem->height * mem->stride * sizeof(int));
+			continue;
+		}
+		for (i = 0; i < mem->nr_pages; i++) {
+			if (pages[i] == ms->pages[i])
+				continue;
+			llsim_put_page(pages[i]);
+			pages[i] = ms->pages[i];
+			if (pages[i] != zero_page)
+				pages[i]->refs++;
+		}
+	}
+	for (i = 0; i < snap->nr_counters; i++)
+		*snap->counters[i] = snap->counter_vals[i];
+}
+
 static void llsim_init_units(char *program_name)
 {
 	llsim->units = NULL;
@@ -307,7 +1305,11 @@ static void llsim_init_units(char *program_name)
 static void llsim_init(char *program_name)
 {
 	llsim = llsim_malloc(sizeof(llsim_t));
+	llsim->stats_next = -1;
 	llsim_init_units(program_name);
+#ifdef LLSIM_STATIC
+	llsim_static_init();
+#endif
 }
 
 static void llsim_init_reset_values(void)
@@ -329,19 +1331,13 @@ static void llsim_init_reset_values(void)
 	}
 }
 
-void llsim_stop(void)
-{
-	stop_sim = 1;
-}
-
-int main(int argc, char **argv)
+/*
+ * registers to their reset values, then 5 clocks with llsim->reset set
+ */
+void llsim_reset(void)
 {
-
 	int i;
 
-	llsim_init(argv[1]);
-
-	llsim_printf("llsim: starting simulation\n");
 	llsim->reset = 1;
 
 	// init registers
@@ -352,15 +1348,311 @@ int main(int argc, char **argv)
 		llsim->clock++;
 	}
 	llsim->reset = 0;
+}
+
+void llsim_stop(void)
+{
+	stop_sim = 1;
+	llsim_event(LLSIM_EV_STOP, 0, 0);
+}
+
+int llsim_stopped(void)
+{
+	return stop_sim;
+}
+
+FILE *llsim_fopen(char *name, char *mode)
+{
+	llsim_file_t *file;
+	FILE *fp;
+
+	fp = fopen(name, mode);
+	if (fp == NULL)
+		return NULL;
+	file = (llsim_file_t *) llsim_malloc(sizeof(llsim_file_t));
+	file->name = strdup(name);
+	file->fp = fp;
+	file->next = files;
+	files = file;
+	return fp;
+}
+
+void llsim_reopen_files(void)
+{
+	llsim_file_t *file;
+
+	for (file = files; file; file = file->next)
+		llsim_assert(freopen(file->name, "w", file->fp) != NULL, "ERROR: couldn't reopen file %s\n", file->name);
+}
+
+/*
+ * 64 bit FNV-1a hash of a file, 0 if it can't be read
+ */
+unsigned long long llsim_hash_file(char *file_name)
+{
+	unsigned char buf[65536];
+	unsigned long long hash = 0xcbf29ce484222325ull;
+	FILE *fp;
+	size_t n, i;
+
+	fp = fopen(file_name, "r");
+	if (fp == NULL)
+		return 0;
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		for (i = 0; i < n; i++)
+			hash = (hash ^ buf[i]) * 0x100000001b3ull;
+	fclose(fp);
+	return hash;
+}
+
+static void llsim_parse_param(char *arg)
+{
+	llsim_param_value_t *pv;
+	char *eq;
+
+	eq = strchr(arg, '=');
+	if (eq == NULL || strchr(arg, '.') == NULL || strchr(arg, '.') > eq) {
+		printf("llsim: bad parameter %s, expected unit.name=value\n", arg);
+		exit(1);
+	}
+	pv = (llsim_param_value_t *) malloc(sizeof(llsim_param_value_t));
+	pv->name = strndup(arg, eq - arg);
+	pv->val = strtol(eq + 1, NULL, 0);
+	pv->used = 0;
+	pv->next = param_values;
+	param_values = pv;
+}
+
+static void llsim_check_params(void)
+{
+	llsim_param_value_t *pv;
+
+	for (pv = param_values; pv; pv = pv->next) {
+		if (!pv->used) {
+			printf("llsim: unknown parameter %s\n", pv->name);
+			exit(1);
+		}
+	}
+}
+
+static void usage(char *prog)
+{
+	printf("usage: %s [options] program\n"
+	       "       %s -R log [-r from-to] [-V vcd_file]\n"
+	       "  -p unit.param=value     set a parameter\n"
+	       "  -b pc                   break at pc\n"
+	       "  -w mem:a[-b][:r|w|rw]   watch memory accesses\n"
+	       "  -c 'unit.reg OP value'  break when a register condition becomes true\n"
+	       "  -C cycles               break at clock cycles\n"
+	       "  -I insts                break after insts instructions\n"
+	       "  -H                      headless, write a checkpoint on a break and continue\n"
+	       "  -s sweep_file           fork a child per line of sweep_file ...\n"
+	       "  -S cycle                ... once the simulation reaches cycle\n"
+	       "  -t name                 publish live statistics to shared memory object name ...\n"
+	       "  -T cycles               ... every cycles clocks (default %d)\n"
+	       "  -q                      quiet, no cycle traces and per cycle prints\n"
+	       "  -r from-to              cycle traces and prints only for clocks from .. to - 1,\n"
+	       "                          cycle_trace.txt labels clock n as the sp's cycle n - 5\n"
+	       "  -V vcd_file             write a waveform of the registers for the traced clocks\n"
+	       "  -L log                  log the retired instructions to log\n"
+	       "  -R log                  replay log, checking the re-simulation against it\n"
+	       "  -j threads              evaluate the units on up to threads threads,\n"
+	       "                          all of them with -p llsim.par_sync_ns=0\n"
+	       "  -B batch_file           run the program once per line of batch_file, in lockstep\n"
+	       "  -F programs[:seed]      run programs random programs instead of a program file\n"
+	       "  -D file                 map file as the block device, see sp.h. not with -L or -R\n"
+	       "  -K                      check every instruction against a reference model, see sp_check.c\n",
+	       prog, prog, LLSIM_STATS_PERIOD);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+
+	int i, opt, nr_bp_args = 0, sweep_cycle = 0, stats_period = LLSIM_STATS_PERIOD;
+	int trace_from = 0, trace_to = INT_MAX, nr_params = 0, nr_log_params, threads = 1;
+	char bp_opts[64], *bp_args[64], *sweep_file = NULL, *stats_name = NULL;
+	char *log_file = NULL, *replay_file = NULL, *vcd_file = NULL, *program_name, **log_params;
+	char *batch_file = NULL, *blk_file = NULL;
+	int fuzz_programs = 0, check = 0, diverged = 0;
+	unsigned int fuzz_seed = 1;
+
+	while ((opt = getopt(argc, argv, "p:b:w:c:C:I:Hs:S:t:T:qr:V:L:R:j:B:F:D:K")) != -1) {
+		switch (opt) {
+		case 'p':
+			llsim_parse_param(optarg);
+			nr_params++;
+			break;
+		case 'b':
+		case 'w':
+		case 'c':
+		case 'C':
+		case 'I':
+			// resolved once the units are registered
+			if (nr_bp_args == 64)
+				usage(argv[0]);
+			bp_opts[nr_bp_args] = opt;
+			bp_args[nr_bp_args++] = optarg;
+			break;
+		case 'H':
+			llsim_bp_set_headless(1);
+			break;
+		case 's':
+			sweep_file = optarg;
+			break;
+		case 'S':
+			sweep_cycle = atoi(optarg);
+			break;
+		case 't':
+			stats_name = optarg;
+			break;
+		case 'T':
+			stats_period = atoi(optarg);
+			break;
+		case 'q':
+			trace_to = 0;
+			break;
+		case 'r':
+			if (sscanf(optarg, "%d-%d", &trace_from, &trace_to) != 2)
+				usage(argv[0]);
+			break;
+		case 'V':
+			vcd_file = optarg;
+			break;
+		case 'L':
+			log_file = optarg;
+			break;
+		case 'R':
+			replay_file = optarg;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			break;
+		case 'B':
+			batch_file = optarg;
+			break;
+		case 'F':
+			if (sscanf(optarg, "%d:%u", &fuzz_programs, &fuzz_seed) < 1 || fuzz_programs < 1)
+				usage(argv[0]);
+			break;
+		case 'D':
+			blk_file = optarg;
+			sp_mmio_set_block_file(optarg);
+			break;
+		case 'K':
+			check = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	// a log holds neither the block device nor the writes a run leaves in it
+	if (blk_file && (log_file || replay_file))
+		usage(argv[0]);
+
+	if (replay_file) {
+		// the program and parameters come from the log
+		if (optind < argc || nr_params || log_file || sweep_file)
+			usage(argv[0]);
+		if (llsim_log_load(replay_file, &program_name, &log_params, &nr_log_params) < 0)
+			exit(1);
+		for (i = 0; i < nr_log_params; i++)
+			llsim_parse_param(log_params[i]);
+	} else if (fuzz_programs) {
+		// the fuzz driver generates the programs, one at a time
+		if (optind < argc || threads > 1 || batch_file || sweep_file || log_file || check)
+			usage(argv[0]);
+		program_name = NULL;
+	} else {
+		if (optind >= argc)
+			usage(argv[0]);
+		program_name = argv[optind];
+	}
+
+	llsim_init(program_name);
+	if (llsim_par_init(threads) < 0)
+		exit(1);
+	llsim_check_params();
+
+	// the checker thread would not survive the fork of a sweep child
+	if (check && (batch_file || sweep_file))
+		usage(argv[0]);
+
+	if (batch_file)
+		return sp_batch_run(batch_file);
+	if (fuzz_programs)
+		return sp_fuzz_run(fuzz_programs, fuzz_seed);
+
+	if (log_file && llsim_log_open(log_file, program_name) < 0)
+		exit(1);
+	llsim_log_start_replay();
+	if (vcd_file && llsim_vcd_open(vcd_file) < 0)
+		exit(1);
+	if (trace_from < trace_to) {
+		llsim_observe(LLSIM_EV_MASK(LLSIM_EV_MEM_READ) | LLSIM_EV_MASK(LLSIM_EV_MEM_WRITE), llsim_print_mem_event, NULL);
+		sp_trace_start();
+	}
+	if (check)
+		sp_check_start();
+
+	for (i = 0; i < nr_bp_args; i++) {
+		switch (bp_opts[i]) {
+		case 'b':
+			opt = llsim_bp_add_pc(bp_args[i], 1);
+			break;
+		case 'w':
+			opt = llsim_bp_add_watch(bp_args[i]);
+			break;
+		case 'c':
+			opt = llsim_bp_add_cond(bp_args[i]);
+			break;
+		case 'C':
+			llsim_bp_set_cycle_limit(atoi(bp_args[i]));
+			opt = 0;
+			break;
+		default:
+			llsim_bp_set_inst_limit(atoll(bp_args[i]));
+			opt = 0;
+			break;
+		}
+		if (opt < 0)
+			exit(1);
+	}
+
+	if (sweep_file && llsim_sweep_load(sweep_file, sweep_cycle) < 0)
+		exit(1);
+
+	llsim_printf("llsim: starting simulation\n");
+	llsim_reset();
+
+	if (stats_name && llsim_stats_open(stats_name, stats_period) < 0)
+		exit(1);
+
 	while (!stop_sim) {
-		printf(">>>>> clock %d <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<\n", llsim->clock);
+		if (llsim_sweep_cycle() >= 0 && llsim->clock >= llsim_sweep_cycle())
+			llsim_sweep_fork();
+		llsim->trace = llsim->clock >= trace_from && llsim->clock < trace_to;
+		if (llsim->trace) {
+			printf(">>>>> clock %d <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<\n", llsim->clock);
+			llsim_vcd_sample();
+		}
 		llsim_run_clock();
 		llsim->clock++;
-		/*
-		if ((llsim->clock % 1000000) == 0)
-			printf("clock %d\n", llsim->clock);
-		*/
+		if (llsim->bp_enabled)
+			llsim_bp_check();
+		if (llsim->bp_hit)
+			llsim_bp_handle();
+		if (llsim->clock == llsim->stats_next)
+			llsim_stats_publish();
 	}
-	return 0;
+	llsim_assert(llsim_sweep_cycle() < 0, "ERROR: simulation ended before sweep cycle %d\n", llsim_sweep_cycle());
+	llsim_event_flush();
+	if (check)
+		diverged = sp_check_finish() < 0;
+	llsim_stats_close();
+	llsim_log_close();
+	llsim_print_counters(stdout);
+	llsim_sweep_finish();
+	return diverged;
 }
-
@@ -3,6 +3,12 @@
 typedef long long i64;
 
 void sp_init(char *program_name);
+void sp_mmio_set_block_file(char *file_name);
+int sp_batch_run(char *file_name);
+int sp_fuzz_run(int nr_programs, unsigned int seed);
+void sp_trace_start(void);
+void sp_check_start(void);
+int sp_check_finish(void);
 
 /*
  * support functions
@@ -12,7 +18,7 @@ void sp_init(char *program_name);
 		if (!(cond)) {						\
 			printf("llsim: clock %d: assertion failed at file %s line %d: ", llsim->clock, __FILE__, __LINE__); \
 			printf(args);					\
-			exit (1);					\
+			llsim_fail();					\
 		}							\
 	} while (0);							\
 
@@ -20,6 +26,13 @@ void sp_init(char *program_name);
 
 #define llsim_error(args...) llsim_assert(0, args)
 
+/*
+ * called when an assertion failed. exits, unless llsim_fail_hook is set and
+ * does not return, e.g. a fuzz driver longjmp()ing to its next program
+ */
+extern void (*llsim_fail_hook)(void);
+void llsim_fail(void);
+
 static inline int bitmask0(bits)
 {
 	if (bits == 32)
@@ -85,7 +98,7 @@ static inline i64 lsbs(i64 val, int msb, int lsb)
 
 static inline i64 lrbs(i64 val, int data, int msb, int lsb)
 {
-	val = (val & (~lbitmask(msb,lsb))) | ((data << lsb) & bitmask(msb,lsb));
+	val = (val & (~lbitmask(msb,lsb))) | ((((i64) data) << lsb) & lbitmask(msb,lsb));
 	return val;
 }
 
@@ -117,25 +130,119 @@ typedef struct llsim_unit_registers_s {
 
 /*
  * memory
+ *
+ * entries wider than 32 bits are stored as entry_size little endian 32 bit
+ * words. wide entries are padded to a power of two stride and the storage is
+ * LLSIM_MEM_ALIGN aligned, so every entry of a 128 bit or wider memory starts
+ * on a vector boundary.
+ */
+#define LLSIM_MEM_MAX_BITS	512
+#define LLSIM_MEM_ALIGN		64
+
+/*
+ * paged memories allocate LLSIM_MEM_PAGE_SIZE byte pages on the first write
+ * to them. untouched pages read from a single shared zero page, and pages
+ * may be shared copy-on-write between memories with llsim_mem_share().
+ */
+#define LLSIM_MEM_PAGE_SIZE	16384
+
+typedef struct llsim_mem_page_s {
+	int refs;
+	int data[] __attribute__ ((aligned (LLSIM_MEM_ALIGN)));
+} llsim_mem_page_t;
+
+/*
+ * memory timing
+ *
+ * an entry address maps to bank addr % banks. an access occupies its bank
+ * for bank_cycle cycles (a read) or write_latency cycles (a write), and a
+ * unit must only issue to a bank for which llsim_mem_ready() is true. a
+ * write is applied when issued. the data of a read issued with tag t shows
+ * up in dataout read_latency cycles later, in the cycle where
+ * llsim_mem_valid(mem, t) is true. all four default to 1, which is a
+ * single-cycle memory: dataout is valid the cycle after the read.
  */
+#define LLSIM_MEM_MAX_BANKS	32
+#define LLSIM_MEM_MAX_LATENCY	64
+
+typedef struct llsim_mem_bank_s {
+	int busy_until;		// first clock the bank is free again
+	i64 accesses;
+	i64 busy_cycles;
+	i64 stall_cycles;	// llsim_mem_ready() calls that returned 0
+} llsim_mem_bank_t;
+
 typedef struct llsim_memory_s {
 	int entry_size;
+	int stride;
 	int bits;
 	int height;
 	int dp;
 	int *data;
 	char *name;
 
+	// paged backend, data is NULL
+	llsim_mem_page_t **pages;
+	int nr_pages;
+	int page_shift;
+	i64 pages_allocated;
+
 	int read;
 	int read_addr;
 	int write;
 	int write_addr;
+	int write_masked;
 	int *datain;
 	int *dataout;
+	int *writemask;
+
+	// units that issued a read / write this clock, one bit per unit index
+	unsigned long long read_units;
+	unsigned long long write_units;
+
+	// timing, see above
+	int read_latency;
+	int write_latency;
+	int bank_cycle;
+	int banks;
+	llsim_mem_bank_t bank[LLSIM_MEM_MAX_BANKS];
+	int read_tag;
+	int valid;
+	int valid_tag;
+
+	// reads in flight, indexed by due clock % LLSIM_MEM_MAX_LATENCY
+	int *pending_data;
+	int pending[LLSIM_MEM_MAX_LATENCY];
+	int pending_tag[LLSIM_MEM_MAX_LATENCY];
+
+	// watchpoint bitmaps, one bit per entry
+	unsigned int *watch_r;
+	unsigned int *watch_w;
+
+	// memory mapped devices, see below
+	struct llsim_device_s *devices;
 
 	struct llsim_memory_s *next;
 } llsim_memory_t;
 
+/*
+ * memory mapped device
+ *
+ * a device claims the entries base .. base + size - 1 of a 32 bit memory,
+ * which may lie beyond its height. accesses there go to the device instead
+ * of the storage, with the timing of the memory: read() is called when the
+ * read is issued and returns the entry, write() gets the entry written.
+ */
+typedef struct llsim_device_s {
+	char *name;
+	unsigned int base;
+	unsigned int size;
+	int (*read)(struct llsim_device_s *dev, unsigned int offset);
+	void (*write)(struct llsim_device_s *dev, unsigned int offset, int val);
+	void *private;
+	struct llsim_device_s *next;
+} llsim_device_t;
+
 typedef struct llsim_register_s {
 	char *unit_name;
 	char *reg_name;
@@ -164,11 +271,34 @@ typedef struct llsim_input_s {
 	struct llsim_input_s *next;
 } llsim_input_t;
 
+/*
+ * run time parameter, set with -p unit.name=value on the command line
+ */
+typedef struct llsim_param_s {
+	char *unit_name;
+	char *param_name;
+	int *valp;
+	struct llsim_param_s *next;
+} llsim_param_t;
+
+/*
+ * statistics counter, printed when the simulation ends
+ */
+typedef struct llsim_counter_s {
+	char *unit_name;
+	char *counter_name;
+	i64 *valp;
+	struct llsim_counter_s *next;
+} llsim_counter_t;
+
 /*
  * simulated unit
  */
+#define LLSIM_MAX_UNITS		64
+
 typedef struct llsim_unit_s {
 	char *name;
+	int index;		// registration order, for port conflict masks
 	void (*run) (struct llsim_unit_s *unit);
 	llsim_unit_registers_t *regs;
 	void *private;
@@ -176,9 +306,21 @@ typedef struct llsim_unit_s {
 	llsim_register_t *registers;
 	llsim_output_t *outputs;
 	llsim_input_t *inputs;
+	llsim_param_t *params;
+	llsim_counter_t *counters;
 	struct llsim_unit_s *next;
 } llsim_unit_t;
 
+/*
+ * unit run functions. the static build (make llsim-static) calls them by
+ * name from llsim_run_clock(), following sp_topology.h
+ */
+#ifdef LLSIM_STATIC
+#define LLSIM_UNIT_RUN
+#else
+#define LLSIM_UNIT_RUN static
+#endif
+
 /*
  * chip simulator main structure
  */
@@ -186,11 +328,20 @@ typedef struct llsim_s {
 	llsim_unit_t *units;
 	int clock;
 	int reset;
+	int bp_enabled;
+	int bp_hit;
+	int stats_next;		// clock of the next live statistics update, -1 if off
+	int trace;		// 1 while the per cycle traces and prints are on
+	int logging;		// 1 while events go to / are checked against a log
 } llsim_t;
 
-llsim_t *llsim;
+extern llsim_t *llsim;
+
+// the unit being evaluated by this thread
+extern __thread llsim_unit_t *llsim_current_unit;
 
 void *llsim_malloc(int len);
+void *llsim_malloc_aligned(int len);
 llsim_unit_t *llsim_register_unit(char *name, void (*run) (struct llsim_unit_s *unit));
 llsim_unit_t *llsim_find_unit(char *name);
 llsim_unit_registers_t *llsim_allocate_registers(llsim_unit_t *unit, char *name, int size);
@@ -200,17 +351,178 @@ void llsim_register_register(char *unit_name, char *reg_name, int bits, int rese
 void llsim_register_wire(char *unit_name, char *wire_name, int bits, void *wirep);
 void llsim_register_output(char *unit_name, char *output_name, int bits, void *oldp, void *newp);
 void llsim_register_input(char *unit_name, char *input_name, int bits, void *oldp, void *newp);
+llsim_output_t *llsim_find_output(char *unit_name, char *output_name);
+void llsim_register_param(char *unit_name, char *param_name, int *valp, int default_value);
+int llsim_engine_param(char *param_name, int default_value);
+void llsim_set_param(char *name, int val);
+void llsim_register_counter(char *unit_name, char *counter_name, i64 *valp);
+void llsim_print_counters(FILE *fp);
+llsim_register_t *llsim_find_register(char *name);
+i64 *llsim_find_counter(char *name);
+int *llsim_find_param(char *name);
 void llsim_stop(void);
+FILE *llsim_fopen(char *name, char *mode);
+unsigned long long llsim_hash_file(char *file_name);
+void llsim_reopen_files(void);
 
 /*
  * memories
  */
 llsim_memory_t *llsim_allocate_memory(llsim_unit_t *unit, char *name, int bits, int height, int dp);
+llsim_memory_t *llsim_allocate_paged_memory(llsim_unit_t *unit, char *name, int bits, int height, int dp);
+llsim_memory_t *llsim_find_memory(char *unit_name, char *name);
+void llsim_mem_share(llsim_memory_t *dst, llsim_memory_t *src);
+llsim_device_t *llsim_mem_map_device(llsim_memory_t *memory, char *name, unsigned int base, unsigned int size,
+				     int (*read)(llsim_device_t *dev, unsigned int offset),
+				     void (*write)(llsim_device_t *dev, unsigned int offset, int val), void *private);
+void llsim_mem_dump_hex(llsim_memory_t *memory, FILE *fp, int height);
 void llsim_mem_inject(llsim_memory_t *memory, int addr, int val, int msb, int lsb);
 int llsim_mem_extract(llsim_memory_t *memory, int addr, int msb, int lsb);
+void llsim_mem_inject_entry(llsim_memory_t *memory, int addr, const int *val);
+void llsim_mem_extract_entry(llsim_memory_t *memory, int addr, int *val);
 void llsim_mem_set_datain(llsim_memory_t *memory, int val, int msb, int lsb);
+void llsim_mem_set_datain_entry(llsim_memory_t *memory, const int *val);
 void llsim_mem_write(llsim_memory_t *memory, int addr);
+void llsim_mem_write_masked(llsim_memory_t *memory, int addr, const int *mask);
 void llsim_mem_read(llsim_memory_t *memory, int addr);
+void llsim_mem_read_tag(llsim_memory_t *memory, int addr, int tag);
+int llsim_mem_ready(llsim_memory_t *memory, int addr);
+int llsim_mem_valid(llsim_memory_t *memory, int tag);
+void llsim_mem_register_timing(llsim_memory_t *memory, char *unit_name);
 int llsim_mem_extract_dataout(llsim_memory_t *memory, int msb, int lsb);
+void llsim_mem_extract_dataout_entry(llsim_memory_t *memory, int *val);
 void llsim_run_clock(void);
+void llsim_run_unit(llsim_unit_t *unit);
+void llsim_reset(void);
+int llsim_stopped(void);
+
+/*
+ * snapshot of the simulation state: the clock, the registers, memories and
+ * counters of every unit. paged memories keep copy-on-write references to
+ * their pages, so taking a snapshot copies no memory and restoring one
+ * only swaps back the pages written since.
+ */
+typedef struct llsim_snapshot_s llsim_snapshot_t;
+
+llsim_snapshot_t *llsim_snapshot_take(void);
+void llsim_snapshot_restore(llsim_snapshot_t *snap);
+
+/*
+ * breakpoints, watchpoints and run limits
+ */
+int llsim_bp_add_pc(char *spec, int enable);
+int llsim_bp_add_watch(char *spec);
+int llsim_bp_add_cond(char *spec);
+void llsim_bp_set_cycle_limit(int cycles);
+void llsim_bp_set_inst_limit(i64 insts);
+void llsim_bp_set_headless(int val);
+void llsim_bp_hit(const char *fmt, ...);
+void llsim_bp_check(void);
+void llsim_bp_handle(void);
+int llsim_checkpoint_save(char *file_name);
+
+/*
+ * parameter sweeps
+ */
+int llsim_sweep_load(char *file_name, int cycle);
+int llsim_sweep_cycle(void);
+void llsim_sweep_fork(void);
+void llsim_sweep_finish(void);
+
+/*
+ * retired instruction log and replay, see llsim_log.c
+ */
+#define LLSIM_LOG_END		0
+#define LLSIM_LOG_RETIRE	1	// a = pc, b = instruction
+#define LLSIM_LOG_LOAD		2	// a = address, b = loaded value
+#define LLSIM_LOG_DMA		3	// a = destination address, b = value
+#define LLSIM_LOG_IRQ		4	// a = interrupted pc, b = vector
+
+int llsim_log_open(char *file_name, char *program_name);
+int llsim_log_load(char *file_name, char **program_name, char ***params, int *nr_params);
+void llsim_log_start_replay(void);
+int llsim_log_replaying(void);
+void llsim_log_event(int type, int a, int b);
+void llsim_log_close(void);
+
+/*
+ * VCD waveform of the registers
+ */
+int llsim_vcd_open(char *file_name);
+void llsim_vcd_sample(void);
+
+/*
+ * parallel clock engine, see llsim_par.c
+ */
+int llsim_par_init(int threads);
+int llsim_par_enabled(void);
+void llsim_par_run_units(void);
+void llsim_par_after_fork(void);
+
+/*
+ * event observers, see llsim_event.c
+ *
+ * an observer registers for a mask of event types and is called with each
+ * event as it happens, or with batches of up to batch events. a call site
+ * costs one test of llsim_observed while nothing observes its event type.
+ */
+#define LLSIM_EV_RETIRE		0	// a = pc, b = instruction
+#define LLSIM_EV_MEM_READ	1	// mem, a = address, b = data[31:0], entry = data
+#define LLSIM_EV_MEM_WRITE	2	// mem, a = address, b = data[31:0], entry = data before the write mask
+#define LLSIM_EV_DMA		3	// a = destination address, b = value
+#define LLSIM_EV_STATE		4	// name = state register, a = old state, b = new state
+#define LLSIM_EV_STOP		5
+#define LLSIM_EV_IRQ		6	// a = interrupted pc, b = vector
+#define LLSIM_NR_EVENTS		7
+
+#define LLSIM_EV_MASK(type)	(1u << (type))
+#define LLSIM_EV_ALL		(LLSIM_EV_MASK(LLSIM_NR_EVENTS) - 1)
+
+typedef struct llsim_event_s {
+	int type;
+	int clock;
+	llsim_unit_t *unit;		// reporting unit, NULL for memory events
+	llsim_memory_t *mem;
+	const char *name;
+	int a;
+	int b;
+	const int *entry;		// only valid during an unbatched call
+} llsim_event_t;
+
+typedef void (*llsim_observer_fn)(const llsim_event_t *ev, void *arg);
+typedef void (*llsim_batch_observer_fn)(const llsim_event_t *ev, int n, void *arg);
+
+extern unsigned int llsim_observed;	// mask of the event types observed
+
+void llsim_observe(unsigned int types, llsim_observer_fn fn, void *arg);
+void llsim_observe_batch(unsigned int types, int batch, llsim_batch_observer_fn fn, void *arg);
+void llsim_event_post(int type, llsim_memory_t *mem, const char *name, int a, int b, const int *entry);
+void llsim_event_deliver_units(void);
+void llsim_event_flush(void);
+
+static inline int llsim_observing(int type)
+{
+	return __builtin_expect(llsim_observed & LLSIM_EV_MASK(type), 0) != 0;
+}
+
+static inline void llsim_event(int type, int a, int b)
+{
+	if (llsim_observing(type))
+		llsim_event_post(type, NULL, NULL, a, b, NULL);
+}
+
+static inline void llsim_event_state(const char *name, int from, int to)
+{
+	if (llsim_observing(LLSIM_EV_STATE) && from != to)
+		llsim_event_post(LLSIM_EV_STATE, NULL, name, from, to, NULL);
+}
+
+/*
+ * live statistics, see llsim_stats.h
+ */
+#define LLSIM_STATS_PERIOD	65536
+
+int llsim_stats_open(char *name, int period);
+void llsim_stats_publish(void);
+void llsim_stats_close(void);
 #endif
@@ -0,0 +1,482 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include "llsim.h"
+
+/*
+ * breakpoints, watchpoints and run limits
+ *
+ * everything is resolved to pointers and bitmaps when it is set, so the per
+ * cycle check in llsim_bp_check() is a bitmap test of the pc plus one
+ * compare per register condition. memory watchpoints are tested by
+ * llsim_run_clock() only for memories that have a watch bitmap.
+ */
+#define BP_MAX_CONDS	32
+#define BP_PC_MAX_BITS	24
+
+enum { COND_EQ, COND_NE, COND_LT, COND_LE, COND_GT, COND_GE, COND_AND };
+
+typedef struct bp_cond_s {
+	int *valp;
+	int op;
+	int val;
+	int last;
+	char *text;
+} bp_cond_t;
+
+static llsim_register_t *pc_reg = NULL;
+static unsigned int *pc_bitmap = NULL;
+static int nr_pc_bps = 0;
+static int last_pc = -1;
+
+static bp_cond_t conds[BP_MAX_CONDS];
+static int nr_conds = 0;
+
+static int cycle_limit = -1;
+static i64 inst_limit = -1;
+static i64 *inst_counter = NULL;
+
+// the prompt's s / n target, apart from the -C / -I limits
+static int step_cycle = -1;
+static i64 step_inst = -1;
+
+static int headless = 0;
+static char hit_reason[256];
+
+static inline int test_bit(unsigned int *bitmap, unsigned int bit)
+{
+	return (bitmap[bit / 32] >> (bit % 32)) & 1;
+}
+
+static inline void set_bit(unsigned int *bitmap, unsigned int bit)
+{
+	bitmap[bit / 32] |= 1u << (bit % 32);
+}
+
+static inline void clear_bit(unsigned int *bitmap, unsigned int bit)
+{
+	bitmap[bit / 32] &= ~(1u << (bit % 32));
+}
+
+static void llsim_bp_update_enabled(void)
+{
+	llsim->bp_enabled = nr_pc_bps || nr_conds || cycle_limit >= 0 || inst_limit >= 0 ||
+			    step_cycle >= 0 || step_inst >= 0;
+}
+
+/*
+ * pc breakpoints. the pc is the first register called "pc"
+ */
+int llsim_bp_add_pc(char *spec, int enable)
+{
+	llsim_unit_t *unit;
+	llsim_register_t *reg;
+	unsigned int pc;
+
+	if (pc_reg == NULL) {
+		for (unit = llsim->units; unit && !pc_reg; unit = unit->next)
+			for (reg = unit->registers; reg && !pc_reg; reg = reg->next)
+				if (strcmp(reg->reg_name, "pc") == 0)
+					pc_reg = reg;
+		if (pc_reg == NULL) {
+			printf("llsim: no pc register\n");
+			return -1;
+		}
+		llsim_assert(pc_reg->bits <= BP_PC_MAX_BITS, "ERROR: %d bit pc too wide for breakpoints\n", pc_reg->bits);
+		pc_bitmap = (unsigned int *) llsim_malloc(((1 << pc_reg->bits) + 31) / 32 * sizeof(int));
+	}
+	pc = strtoul(spec, NULL, 0);
+	if (pc >= (1u << pc_reg->bits)) {
+		printf("llsim: pc %s out of range\n", spec);
+		return -1;
+	}
+	if (enable && !test_bit(pc_bitmap, pc)) {
+		set_bit(pc_bitmap, pc);
+		nr_pc_bps++;
+	} else if (!enable && test_bit(pc_bitmap, pc)) {
+		clear_bit(pc_bitmap, pc);
+		nr_pc_bps--;
+	}
+	llsim_bp_update_enabled();
+	return 0;
+}
+
+/*
+ * memory watchpoints, [unit.]mem:addr[-last][:r|w|rw]
+ */
+int llsim_bp_add_watch(char *spec)
+{
+	llsim_unit_t *unit;
+	llsim_memory_t *mem;
+	char name[64], mode[4];
+	unsigned int first, last, addr;
+	int n;
+
+	strcpy(mode, "w");
+	n = sscanf(spec, "%63[^:]:%i-%i:%3s", name, &first, &last, mode);
+	if (n < 3) {
+		n = sscanf(spec, "%63[^:]:%i:%3s", name, &first, mode);
+		last = first;
+		if (n < 2) {
+			printf("llsim: bad watchpoint %s, expected mem:addr[-last][:r|w|rw]\n", spec);
+			return -1;
+		}
+	}
+
+	mem = NULL;
+	for (unit = llsim->units; unit && !mem; unit = unit->next)
+		for (mem = unit->mems; mem; mem = mem->next)
+			if (strcmp(mem->name, name) == 0)
+				break;
+	if (mem == NULL) {
+		printf("llsim: no memory %s\n", name);
+		return -1;
+	}
+	if (first > last || last >= mem->height) {
+		printf("llsim: bad range %d-%d for memory %s\n", first, last, name);
+		return -1;
+	}
+
+	if (strchr(mode, 'r') && mem->watch_r == NULL)
+		mem->watch_r = (unsigned int *) llsim_malloc((mem->height + 31) / 32 * sizeof(int));
+	if (strchr(mode, 'w') && mem->watch_w == NULL)
+		mem->watch_w = (unsigned int *) llsim_malloc((mem->height + 31) / 32 * sizeof(int));
+	for (addr = first; addr <= last; addr++) {
+		if (strchr(mode, 'r'))
+			set_bit(mem->watch_r, addr);
+		if (strchr(mode, 'w'))
+			set_bit(mem->watch_w, addr);
+	}
+	return 0;
+}
+
+/*
+ * register conditions, unit.reg OP value with OP one of == != < <= > >= &
+ * (& is true when any of the bits in value are set). a condition hits when
+ * it becomes true.
+ */
+int llsim_bp_add_cond(char *spec)
+{
+	static const char *ops[] = { "==", "!=", "<=", ">=", "<", ">", "&" };
+	static const int op_codes[] = { COND_EQ, COND_NE, COND_LE, COND_GE, COND_LT, COND_GT, COND_AND };
+	llsim_register_t *reg;
+	bp_cond_t *cond;
+	char name[128], *p;
+	int i, len;
+
+	if (nr_conds == BP_MAX_CONDS) {
+		printf("llsim: too many conditions\n");
+		return -1;
+	}
+	for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+		if ((p = strstr(spec, ops[i])) != NULL)
+			break;
+	if (p == NULL || p - spec >= sizeof(name)) {
+		printf("llsim: bad condition %s, expected unit.reg OP value\n", spec);
+		return -1;
+	}
+	len = p - spec;
+	while (len > 0 && spec[len - 1] == ' ')
+		len--;
+	memcpy(name, spec, len);
+	name[len] = 0;
+	reg = llsim_find_register(name);
+	if (reg == NULL) {
+		printf("llsim: no register %s\n", name);
+		return -1;
+	}
+
+	cond = &conds[nr_conds++];
+	cond->valp = (int *) reg->oldp;
+	cond->op = op_codes[i];
+	cond->val = strtol(p + strlen(ops[i]), NULL, 0);
+	cond->last = 0;
+	cond->text = strdup(spec);
+	llsim_bp_update_enabled();
+	return 0;
+}
+
+void llsim_bp_set_cycle_limit(int cycles)
+{
+	cycle_limit = cycles;
+	llsim_bp_update_enabled();
+}
+
+static void llsim_bp_find_inst_counter(void)
+{
+	if (inst_counter == NULL)
+		inst_counter = llsim_find_counter("sp.instructions");
+	llsim_assert(inst_counter != NULL, "ERROR: no instruction counter\n");
+}
+
+void llsim_bp_set_inst_limit(i64 insts)
+{
+	llsim_bp_find_inst_counter();
+	inst_limit = insts;
+	llsim_bp_update_enabled();
+}
+
+// stop after n clocks, or n instructions with insts set
+static void llsim_bp_step(int n, int insts)
+{
+	step_cycle = -1;
+	step_inst = -1;
+	if (insts) {
+		llsim_bp_find_inst_counter();
+		step_inst = *inst_counter + n;
+	} else {
+		step_cycle = llsim->clock + n;
+	}
+	llsim_bp_update_enabled();
+}
+
+void llsim_bp_set_headless(int val)
+{
+	headless = val;
+}
+
+void llsim_bp_hit(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (llsim->bp_hit)
+		return;
+	va_start(ap, fmt);
+	vsnprintf(hit_reason, sizeof(hit_reason), fmt, ap);
+	va_end(ap);
+	llsim->bp_hit = 1;
+}
+
+static inline int cond_eval(bp_cond_t *cond)
+{
+	int val = *cond->valp;
+
+	switch (cond->op) {
+	case COND_EQ:
+		return val == cond->val;
+	case COND_NE:
+		return val != cond->val;
+	case COND_LT:
+		return val < cond->val;
+	case COND_LE:
+		return val <= cond->val;
+	case COND_GT:
+		return val > cond->val;
+	case COND_GE:
+		return val >= cond->val;
+	default:
+		return (val & cond->val) != 0;
+	}
+}
+
+/*
+ * called after every clock while anything is set
+ */
+void llsim_bp_check(void)
+{
+	bp_cond_t *cond;
+	int pc, val, i;
+
+	if (nr_pc_bps) {
+		pc = *(int *) pc_reg->oldp;
+		if (pc != last_pc) {
+			last_pc = pc;
+			// the pc may run past its register width in a larger sram
+			if ((unsigned int) pc < (1u << pc_reg->bits) && test_bit(pc_bitmap, pc))
+				llsim_bp_hit("breakpoint pc %04x", pc);
+		}
+	}
+	for (i = 0; i < nr_conds; i++) {
+		cond = &conds[i];
+		val = cond_eval(cond);
+		if (val && !cond->last)
+			llsim_bp_hit("condition %s", cond->text);
+		cond->last = val;
+	}
+	if (llsim->clock == cycle_limit)
+		llsim_bp_hit("cycle limit %d", cycle_limit);
+	if (inst_limit >= 0 && *inst_counter >= inst_limit) {
+		llsim_bp_hit("instruction limit %lld", inst_limit);
+		inst_limit = -1;
+		llsim_bp_update_enabled();
+	}
+	if (llsim->clock == step_cycle || (step_inst >= 0 && *inst_counter >= step_inst)) {
+		llsim_bp_hit("step");
+		step_cycle = -1;
+		step_inst = -1;
+		llsim_bp_update_enabled();
+	}
+}
+
+/*
+ * checkpoint: registers and memories of every unit
+ *
+ *   "llsimckp" clock
+ *   per unit: name, per register block: name size data, per memory:
+ *   name height entry_size and the data of every entry
+ */
+static void write_str(FILE *fp, char *s)
+{
+	int len = strlen(s);
+
+	fwrite(&len, sizeof(len), 1, fp);
+	fwrite(s, 1, len, fp);
+}
+
+int llsim_checkpoint_save(char *file_name)
+{
+	llsim_unit_t *unit;
+	llsim_unit_registers_t *ur;
+	llsim_memory_t *mem;
+	int entry[LLSIM_MEM_MAX_BITS / 32];
+	FILE *fp;
+	int addr;
+
+	fp = fopen(file_name, "w");
+	if (fp == NULL) {
+		printf("llsim: couldn't open file %s\n", file_name);
+		return -1;
+	}
+	fwrite("llsimckp", 1, 8, fp);
+	fwrite(&llsim->clock, sizeof(int), 1, fp);
+	for (unit = llsim->units; unit; unit = unit->next) {
+		write_str(fp, unit->name);
+		for (ur = unit->regs; ur; ur = ur->next) {
+			write_str(fp, ur->name);
+			fwrite(&ur->size, sizeof(int), 1, fp);
+			fwrite(ur->old, 1, ur->size, fp);
+		}
+		for (mem = unit->mems; mem; mem = mem->next) {
+			write_str(fp, mem->name);
+			fwrite(&mem->height, sizeof(int), 1, fp);
+			fwrite(&mem->entry_size, sizeof(int), 1, fp);
+			for (addr = 0; addr < mem->height; addr++) {
+				llsim_mem_extract_entry(mem, addr, entry);
+				fwrite(entry, sizeof(int), mem->entry_size, fp);
+			}
+		}
+	}
+	fclose(fp);
+	printf("llsim: clock %d: checkpoint written to %s\n", llsim->clock, file_name);
+	return 0;
+}
+
+/*
+ * command prompt
+ */
+static void print_register(llsim_register_t *reg)
+{
+	printf("%s.%s = 0x%08x (%d)\n", reg->unit_name, reg->reg_name, *(int *) reg->oldp, *(int *) reg->oldp);
+}
+
+static void print_registers(void)
+{
+	llsim_unit_t *unit;
+	llsim_register_t *reg;
+
+	for (unit = llsim->units; unit; unit = unit->next)
+		for (reg = unit->registers; reg; reg = reg->next)
+			print_register(reg);
+}
+
+static void examine_memory(char *name, int addr, int count)
+{
+	llsim_unit_t *unit;
+	llsim_memory_t *mem = NULL;
+	int i;
+
+	for (unit = llsim->units; unit && !mem; unit = unit->next)
+		for (mem = unit->mems; mem; mem = mem->next)
+			if (strcmp(mem->name, name) == 0)
+				break;
+	if (mem == NULL) {
+		printf("no memory %s\n", name);
+		return;
+	}
+	for (i = addr; i < addr + count && i < mem->height; i++)
+		printf("%s[%d] = %08x\n", name, i, llsim_mem_extract(mem, i, 31, 0));
+}
+
+static void prompt_help(void)
+{
+	printf("c                 continue\n"
+	       "s [n]             run n cycles\n"
+	       "n [n]             run n instructions\n"
+	       "p [unit.reg]      print a register, or all registers\n"
+	       "x mem addr [n]    examine memory\n"
+	       "b pc              set a pc breakpoint\n"
+	       "d pc              delete a pc breakpoint\n"
+	       "w mem:a[-b][:rw]  set a memory watchpoint\n"
+	       "cond unit.reg OP value   set a register condition\n"
+	       "dump file         write a checkpoint\n"
+	       "q                 quit\n");
+}
+
+static void llsim_bp_prompt(void)
+{
+	llsim_register_t *reg;
+	char line[256], cmd[32], arg1[128], arg2[64], arg3[64];
+	int n;
+
+	while (1) {
+		printf("llsim %d> ", llsim->clock);
+		fflush(stdout);
+		if (fgets(line, sizeof(line), stdin) == NULL)
+			exit(0);
+		n = sscanf(line, "%31s %127s %63s %63s", cmd, arg1, arg2, arg3);
+		if (n < 1)
+			continue;
+		if (strcmp(cmd, "c") == 0) {
+			return;
+		} else if (strcmp(cmd, "s") == 0) {
+			llsim_bp_step(n > 1 ? atoi(arg1) : 1, 0);
+			return;
+		} else if (strcmp(cmd, "n") == 0) {
+			llsim_bp_step(n > 1 ? atoi(arg1) : 1, 1);
+			return;
+		} else if (strcmp(cmd, "p") == 0) {
+			if (n == 1) {
+				print_registers();
+			} else if ((reg = llsim_find_register(arg1)) != NULL) {
+				print_register(reg);
+			} else {
+				printf("no register %s\n", arg1);
+			}
+		} else if (strcmp(cmd, "x") == 0 && n >= 3) {
+			examine_memory(arg1, strtol(arg2, NULL, 0), n > 3 ? strtol(arg3, NULL, 0) : 1);
+		} else if (strcmp(cmd, "b") == 0 && n >= 2) {
+			llsim_bp_add_pc(arg1, 1);
+		} else if (strcmp(cmd, "d") == 0 && n >= 2) {
+			llsim_bp_add_pc(arg1, 0);
+		} else if (strcmp(cmd, "w") == 0 && n >= 2) {
+			llsim_bp_add_watch(arg1);
+		} else if (strcmp(cmd, "cond") == 0 && n >= 2) {
+			llsim_bp_add_cond(line + strlen("cond") + 1);
+		} else if (strcmp(cmd, "dump") == 0 && n >= 2) {
+			llsim_checkpoint_save(arg1);
+		} else if (strcmp(cmd, "q") == 0) {
+			exit(0);
+		} else {
+			prompt_help();
+		}
+	}
+}
+
+/*
+ * called by the main loop after a clock that hit something
+ */
+void llsim_bp_handle(void)
+{
+	char file_name[64];
+
+	llsim->bp_hit = 0;
+	printf("llsim: clock %d: %s\n", llsim->clock, hit_reason);
+	if (headless || !isatty(0)) {
+		snprintf(file_name, sizeof(file_name), "checkpoint.%d.bin", llsim->clock);
+		llsim_checkpoint_save(file_name);
+		return;
+	}
+	llsim_bp_prompt();
+}
@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "llsim.h"
+
+/*
+ * event observers
+ *
+ * events are delivered in the order they are posted. with the parallel
+ * engine the units run on several threads, so the events a unit posts are
+ * queued per unit and delivered after all units ran, in unit list order:
+ * the same order as a serial run, and the observers are never called
+ * concurrently.
+ *
+ * a batch observer gets copies of its events, up to batch at a time, when
+ * its buffer is full, when the simulation stops and on llsim_event_flush().
+ */
+#define LLSIM_MAX_OBSERVERS	16
+
+typedef struct llsim_observer_s {
+	llsim_observer_fn fn;
+	llsim_batch_observer_fn batch_fn;
+	void *arg;
+	llsim_event_t *buf;
+	int batch;
+	int n;
+} llsim_observer_t;
+
+unsigned int llsim_observed = 0;
+
+static llsim_observer_t observers[LLSIM_MAX_OBSERVERS];
+static int nr_observers = 0;
+static llsim_observer_t *by_type[LLSIM_NR_EVENTS][LLSIM_MAX_OBSERVERS];
+static int nr_by_type[LLSIM_NR_EVENTS];
+
+// events posted by the units while the parallel engine runs them
+static llsim_event_t *unit_events[LLSIM_MAX_UNITS];
+static int nr_unit_events[LLSIM_MAX_UNITS];
+static int max_unit_events[LLSIM_MAX_UNITS];
+
+static llsim_observer_t *add_observer(unsigned int types)
+{
+	llsim_observer_t *obs;
+	int type;
+
+	llsim_assert(nr_observers < LLSIM_MAX_OBSERVERS, "ERROR: too many observers\n");
+	llsim_assert(types && !(types & ~LLSIM_EV_ALL), "ERROR: bad event types %x\n", types);
+	obs = &observers[nr_observers++];
+	for (type = 0; type < LLSIM_NR_EVENTS; type++)
+		if (types & LLSIM_EV_MASK(type))
+			by_type[type][nr_by_type[type]++] = obs;
+	llsim_observed |= types;
+	return obs;
+}
+
+void llsim_observe(unsigned int types, llsim_observer_fn fn, void *arg)
+{
+	llsim_observer_t *obs = add_observer(types);
+
+	obs->fn = fn;
+	obs->arg = arg;
+}
+
+void llsim_observe_batch(unsigned int types, int batch, llsim_batch_observer_fn fn, void *arg)
+{
+	llsim_observer_t *obs;
+
+	llsim_assert(batch >= 1, "ERROR: batch of %d events\n", batch);
+	obs = add_observer(types);
+	obs->batch_fn = fn;
+	obs->arg = arg;
+	obs->batch = batch;
+	obs->buf = (llsim_event_t *) llsim_malloc(batch * sizeof(llsim_event_t));
+}
+
+static void flush(llsim_observer_t *obs)
+{
+	if (obs->n == 0)
+		return;
+	obs->batch_fn(obs->buf, obs->n, obs->arg);
+	obs->n = 0;
+}
+
+void llsim_event_flush(void)
+{
+	int i;
+
+	for (i = 0; i < nr_observers; i++)
+		if (observers[i].batch_fn)
+			flush(&observers[i]);
+}
+
+static void deliver(llsim_event_t *ev)
+{
+	llsim_observer_t *obs;
+	int i;
+
+	for (i = 0; i < nr_by_type[ev->type]; i++) {
+		obs = by_type[ev->type][i];
+		if (obs->fn) {
+			obs->fn(ev, obs->arg);
+			continue;
+		}
+		obs->buf[obs->n] = *ev;
+		obs->buf[obs->n].entry = NULL;
+		if (++obs->n == obs->batch)
+			flush(obs);
+	}
+	if (ev->type == LLSIM_EV_STOP)
+		llsim_event_flush();
+}
+
+void llsim_event_post(int type, llsim_memory_t *mem, const char *name, int a, int b, const int *entry)
+{
+	llsim_unit_t *unit = llsim_current_unit;
+	llsim_event_t ev, *q;
+	int n;
+
+	ev.type = type;
+	ev.clock = llsim->clock;
+	ev.unit = unit;
+	ev.mem = mem;
+	ev.name = name;
+	ev.a = a;
+	ev.b = b;
+	ev.entry = entry;
+	if (!unit || !llsim_par_enabled()) {
+		deliver(&ev);
+		return;
+	}
+
+	// queued until the clock's units all ran, see llsim_event_deliver_units()
+	n = unit->index;
+	if (nr_unit_events[n] == max_unit_events[n]) {
+		max_unit_events[n] = max_unit_events[n] ? 2 * max_unit_events[n] : 16;
+		q = (llsim_event_t *) realloc(unit_events[n], max_unit_events[n] * sizeof(llsim_event_t));
+		llsim_assert(q != NULL, "out of memory");
+		unit_events[n] = q;
+	}
+	ev.entry = NULL;
+	unit_events[n][nr_unit_events[n]++] = ev;
+}
+
+/*
+ * called by llsim_run_clock() after the units ran in parallel
+ */
+void llsim_event_deliver_units(void)
+{
+	llsim_unit_t *unit;
+	int i, n;
+
+	for (unit = llsim->units; unit; unit = unit->next) {
+		n = unit->index;
+		for (i = 0; i < nr_unit_events[n]; i++)
+			deliver(&unit_events[n][i]);
+		nr_unit_events[n] = 0;
+	}
+}
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "llsim.h"
+
+/*
+ * retired instruction log
+ *
+ * the simulation is deterministic given the program and the parameters, so
+ * the log keeps only those plus the events the units report: retired pc and
+ * instruction, load values, DMA words and interrupts. that is enough to
+ * re-simulate any part of a run with the full traces on, and to check that
+ * the re-simulation retires exactly what the logged run did.
+ *
+ * file format:
+ *   "llsimlog" version
+ *   absolute program file name, NUL terminated, and its 64 bit hash
+ *   number of parameters, then "unit.param=value" NUL terminated each
+ *   records: type byte, clock delta, a, b as unsigned LEB128 varints
+ *   LLSIM_LOG_END record with the final clock delta
+ */
+#define LOG_MAGIC	"llsimlog"
+#define LOG_VERSION	1
+
+static FILE *log_fp = NULL;
+static int replaying = 0;
+static int last_clock = 0;
+static i64 nr_records = 0;
+
+static void put_varint(unsigned int val)
+{
+	while (val >= 0x80) {
+		putc((val & 0x7f) | 0x80, log_fp);
+		val >>= 7;
+	}
+	putc(val, log_fp);
+}
+
+static int get_varint(unsigned int *val)
+{
+	int c, shift = 0;
+
+	*val = 0;
+	do {
+		c = getc(log_fp);
+		if (c == EOF || shift > 28)
+			return -1;
+		*val |= (unsigned int) (c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+static int get_string(char *buf, int len)
+{
+	int c, i = 0;
+
+	while ((c = getc(log_fp)) != 0) {
+		if (c == EOF || i == len - 1)
+			return -1;
+		buf[i++] = c;
+	}
+	buf[i] = 0;
+	return 0;
+}
+
+/*
+ * start logging to file_name. called once the units are registered, so
+ * every parameter is logged with its value
+ */
+int llsim_log_open(char *file_name, char *program_name)
+{
+	llsim_unit_t *unit;
+	llsim_param_t *param;
+	unsigned long long hash;
+	char path[PATH_MAX];
+	int n = 0;
+
+	// so that -R works from any directory
+	if (realpath(program_name, path) == NULL) {
+		printf("llsim: couldn't resolve %s\n", program_name);
+		return -1;
+	}
+	log_fp = fopen(file_name, "wb");
+	if (log_fp == NULL) {
+		printf("llsim: couldn't open file %s\n", file_name);
+		return -1;
+	}
+	fwrite(LOG_MAGIC, 1, 8, log_fp);
+	put_varint(LOG_VERSION);
+	fwrite(path, 1, strlen(path) + 1, log_fp);
+	hash = llsim_hash_file(path);
+	fwrite(&hash, sizeof(hash), 1, log_fp);
+	for (unit = llsim->units; unit; unit = unit->next)
+		for (param = unit->params; param; param = param->next)
+			n++;
+	put_varint(n);
+	for (unit = llsim->units; unit; unit = unit->next)
+		for (param = unit->params; param; param = param->next)
+			fprintf(log_fp, "%s.%s=%d%c", param->unit_name, param->param_name, *param->valp, 0);
+	last_clock = llsim->clock;
+	llsim->logging = 1;
+	return 0;
+}
+
+/*
+ * open file_name for a replay. returns the logged program name and
+ * parameters, which must be set before the units are registered
+ */
+int llsim_log_load(char *file_name, char **program_name, char ***params, int *nr_params)
+{
+	char magic[8], buf[PATH_MAX];
+	unsigned long long hash;
+	unsigned int version, n, i;
+
+	log_fp = fopen(file_name, "rb");
+	if (log_fp == NULL) {
+		printf("llsim: couldn't open file %s\n", file_name);
+		return -1;
+	}
+	if (fread(magic, 1, 8, log_fp) != 8 || memcmp(magic, LOG_MAGIC, 8) ||
+	    get_varint(&version) < 0 || version != LOG_VERSION ||
+	    get_string(buf, sizeof(buf)) < 0 || fread(&hash, sizeof(hash), 1, log_fp) != 1 ||
+	    get_varint(&n) < 0) {
+		printf("llsim: %s is not an llsim log\n", file_name);
+		return -1;
+	}
+	if (llsim_hash_file(buf) != hash) {
+		printf("llsim: program %s changed since %s was written\n", buf, file_name);
+		return -1;
+	}
+	*program_name = strdup(buf);
+	*params = (char **) llsim_malloc((n + 1) * sizeof(char *));
+	for (i = 0; i < n; i++) {
+		if (get_string(buf, sizeof(buf)) < 0) {
+			printf("llsim: %s is truncated\n", file_name);
+			return -1;
+		}
+		(*params)[i] = strdup(buf);
+	}
+	*nr_params = n;
+	replaying = 1;
+	return 0;
+}
+
+/*
+ * called by llsim_init() once the units are registered
+ */
+void llsim_log_start_replay(void)
+{
+	if (!replaying)
+		return;
+	last_clock = llsim->clock;
+	llsim->logging = 1;
+}
+
+int llsim_log_replaying(void)
+{
+	return replaying;
+}
+
+static char *type_name(int type)
+{
+	static char *names[] = {"end", "retire", "load", "dma", "irq"};
+
+	return type >= 0 && type <= LLSIM_LOG_IRQ ? names[type] : "bad";
+}
+
+/*
+ * record an event, or check it against the log when replaying
+ */
+void llsim_log_event(int type, int a, int b)
+{
+	unsigned int ltype, delta, la, lb;
+
+	if (!replaying) {
+		putc(type, log_fp);
+		put_varint(llsim->clock - last_clock);
+		put_varint(a);
+		put_varint(b);
+		last_clock = llsim->clock;
+		nr_records++;
+		return;
+	}
+	ltype = getc(log_fp);
+	if (get_varint(&delta) < 0 || get_varint(&la) < 0 || get_varint(&lb) < 0)
+		llsim_error("ERROR: clock %d: replay log ended before %s %d %08x\n", llsim->clock, type_name(type), a, b);
+	llsim_assert(ltype == type && last_clock + delta == llsim->clock && la == a && lb == b,
+		     "ERROR: replay diverged: clock %d %s %d %08x, log has clock %d %s %d %08x\n",
+		     llsim->clock, type_name(type), a, b, last_clock + delta, type_name(ltype), la, lb);
+	last_clock = llsim->clock;
+	nr_records++;
+}
+
+/*
+ * called when the simulation ended
+ */
+void llsim_log_close(void)
+{
+	if (!llsim->logging)
+		return;
+	llsim_log_event(LLSIM_LOG_END, 0, 0);
+	fclose(log_fp);
+	log_fp = NULL;
+	llsim->logging = 0;
+	printf("llsim: %s %lld log records\n", replaying ? "replayed" : "logged", nr_records);
+}
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include "llsim.h"
+
+/*
+ * parallel clock engine
+ *
+ * units only read old registers and write their own new ones while they run,
+ * so the units of a clock can be evaluated in any order and in parallel. the
+ * memories and the register copy stay serial in llsim_run_clock().
+ *
+ * for the first LLSIM_PAR_WARMUP clocks the units run serially and their
+ * run time is measured. they are then split into groups of about equal cost,
+ * one group per thread, using as many groups as pays off against the cost of
+ * the two barriers per clock, llsim.par_sync_ns. small units end up sharing
+ * a group, with llsim.par_sync_ns=0 they are spread over all threads. the
+ * main thread runs group 0, persistent workers run the others.
+ *
+ * memory port conflicts are collected as unit masks and reported with the
+ * unit names sorted, see llsim_mem_clock(), so a conflicting model fails
+ * the same way whatever the thread timing.
+ */
+#define LLSIM_PAR_MAX_THREADS	64
+#define LLSIM_PAR_WARMUP	256
+
+// default estimated cost of one clock's barriers, in ns
+#define LLSIM_PAR_SYNC_NS	500
+
+typedef struct llsim_par_group_s {
+	llsim_unit_t *units[LLSIM_MAX_UNITS];
+	int nr_units;
+	long long cost;
+} llsim_par_group_t;
+
+static int nr_threads = 1;
+static int sync_ns;
+static int started = 0;
+static int warmup_left;
+static long long unit_ns[LLSIM_MAX_UNITS];
+static llsim_par_group_t groups[LLSIM_PAR_MAX_THREADS];
+static int nr_groups = 0;
+static pthread_t workers[LLSIM_PAR_MAX_THREADS];
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	__asm__ __volatile__("" ::: "memory")
+#endif
+
+// sense reversing barrier
+static int bar_count = 0;
+static int bar_sense = 0;
+static int main_sense = 0;
+
+static void barrier(int *sense)
+{
+	int spins = 0;
+
+	*sense = !*sense;
+	if (__atomic_add_fetch(&bar_count, 1, __ATOMIC_ACQ_REL) == nr_groups) {
+		__atomic_store_n(&bar_count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&bar_sense, *sense, __ATOMIC_RELEASE);
+		return;
+	}
+	while (__atomic_load_n(&bar_sense, __ATOMIC_ACQUIRE) != *sense) {
+		if (++spins < 1000)
+			cpu_relax();
+		else
+			sched_yield();
+	}
+}
+
+static void run_group(llsim_par_group_t *group)
+{
+	int i;
+
+	for (i = 0; i < group->nr_units; i++)
+		llsim_run_unit(group->units[i]);
+}
+
+static void *worker(void *arg)
+{
+	llsim_par_group_t *group = (llsim_par_group_t *) arg;
+	int sense = 0;
+
+	for (;;) {
+		barrier(&sense);	// clock starts
+		run_group(group);
+		barrier(&sense);	// clock done
+	}
+	return NULL;
+}
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static int cmp_cost(const void *a, const void *b)
+{
+	llsim_unit_t *ua = *(llsim_unit_t * const *) a;
+	llsim_unit_t *ub = *(llsim_unit_t * const *) b;
+
+	if (unit_ns[ua->index] != unit_ns[ub->index])
+		return unit_ns[ua->index] < unit_ns[ub->index] ? 1 : -1;
+	return ua->index - ub->index;
+}
+
+/*
+ * longest processing time first into n groups, returns the largest group cost
+ */
+static long long partition(llsim_unit_t **units, int nr, int n)
+{
+	long long max = 0;
+	int i, g, min;
+
+	memset(groups, 0, sizeof(groups));
+	for (i = 0; i < nr; i++) {
+		min = 0;
+		for (g = 1; g < n; g++)
+			if (groups[g].cost < groups[min].cost)
+				min = g;
+		groups[min].units[groups[min].nr_units++] = units[i];
+		groups[min].cost += unit_ns[units[i]->index];
+	}
+	for (g = 0; g < n; g++)
+		if (groups[g].cost > max)
+			max = groups[g].cost;
+	return max;
+}
+
+static void start(void)
+{
+	llsim_unit_t *units[LLSIM_MAX_UNITS], *unit;
+	long long cost, best_cost = 0;
+	int nr = 0, n, best = 1, g, i;
+
+	for (unit = llsim->units; unit; unit = unit->next) {
+		unit_ns[unit->index] /= LLSIM_PAR_WARMUP;
+		units[nr++] = unit;
+	}
+	qsort(units, nr, sizeof(llsim_unit_t *), cmp_cost);
+	for (n = 1; n <= nr_threads && n <= nr; n++) {
+		cost = partition(units, nr, n) + (n > 1 ? sync_ns : 0);
+		if (n == 1 || cost < best_cost) {
+			best = n;
+			best_cost = cost;
+		}
+	}
+	partition(units, nr, best);
+	nr_groups = best;
+	started = 1;
+
+	printf("llsim: clock %d: parallel engine, %d group%s:", llsim->clock, nr_groups, nr_groups > 1 ? "s" : "");
+	for (g = 0; g < nr_groups; g++) {
+		printf(" {");
+		for (i = 0; i < groups[g].nr_units; i++)
+			printf("%s%s", i ? " " : "", groups[g].units[i]->name);
+		printf("}");
+	}
+	printf("\n");
+
+	for (g = 1; g < nr_groups; g++)
+		llsim_assert(pthread_create(&workers[g], NULL, worker, &groups[g]) == 0, "ERROR: couldn't create thread\n");
+}
+
+int llsim_par_init(int threads)
+{
+	int cpus, max;
+
+	if (threads < 1 || threads > LLSIM_PAR_MAX_THREADS) {
+		printf("llsim: %d threads not supported\n", threads);
+		return -1;
+	}
+	// spinning threads sharing a cpu only take turns, two still test the engine
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	max = cpus > 2 ? cpus : 2;
+	if (threads > max) {
+		printf("llsim: %d cpus online, using %d threads\n", cpus, max);
+		threads = max;
+	}
+	nr_threads = threads;
+	if (threads > 1)
+		sync_ns = llsim_engine_param("par_sync_ns", LLSIM_PAR_SYNC_NS);
+	warmup_left = LLSIM_PAR_WARMUP;
+	return 0;
+}
+
+int llsim_par_enabled(void)
+{
+	return nr_threads > 1;
+}
+
+void llsim_par_run_units(void)
+{
+	llsim_unit_t *unit;
+	long long t;
+
+	if (!started) {
+		for (unit = llsim->units; unit; unit = unit->next) {
+			t = now_ns();
+			llsim_run_unit(unit);
+			unit_ns[unit->index] += now_ns() - t;
+		}
+		if (--warmup_left == 0)
+			start();
+		return;
+	}
+	if (nr_groups == 1) {
+		run_group(&groups[0]);
+		return;
+	}
+	barrier(&main_sense);
+	run_group(&groups[0]);
+	barrier(&main_sense);
+}
+
+/*
+ * a forked sweep child has no workers, measure and start again
+ */
+void llsim_par_after_fork(void)
+{
+	if (!llsim_par_enabled())
+		return;
+	started = 0;
+	warmup_left = LLSIM_PAR_WARMUP;
+	memset(unit_ns, 0, sizeof(unit_ns));
+	bar_count = 0;
+	bar_sense = 0;
+	main_sense = 0;
+}
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "llsim.h"
+#include "llsim_stats.h"
+
+/*
+ * live statistics
+ *
+ * the segment holds every registered counter and every register called
+ * "pc". an update is a few stores and one clock_gettime() per period
+ * cycles, there is no I/O in the simulation loop. the segment is removed
+ * when the simulation ends, a reader that is still attached sees done set.
+ */
+static llsim_stats_t *seg = NULL;
+static char seg_name[128];
+static pid_t owner = 0;
+static int period;
+static i64 *counters[LLSIM_STATS_MAX_VALUES];
+static llsim_register_t *regs[LLSIM_STATS_MAX_VALUES];
+static long long last_clock, last_ns;
+
+static long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+static void add_value(char *unit_name, char *name, i64 *counter, llsim_register_t *reg)
+{
+	int n = seg->nr_values;
+
+	if (n == LLSIM_STATS_MAX_VALUES)
+		return;
+	snprintf(seg->names[n], LLSIM_STATS_NAME_LEN, "%s.%s", unit_name, name);
+	counters[n] = counter;
+	regs[n] = reg;
+	seg->nr_values++;
+}
+
+static void remove_segment(void)
+{
+	if (owner == getpid()) {
+		shm_unlink(seg_name);
+		owner = 0;
+	}
+}
+
+int llsim_stats_open(char *name, int cycles)
+{
+	llsim_unit_t *unit;
+	llsim_counter_t *counter;
+	llsim_register_t *reg;
+	int fd;
+
+	if (name[0] == '/')
+		snprintf(seg_name, sizeof(seg_name), "%s", name);
+	else
+		snprintf(seg_name, sizeof(seg_name), "/%s", name);
+	fd = shm_open(seg_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(llsim_stats_t)) < 0) {
+		printf("llsim: couldn't create shared memory segment %s\n", seg_name);
+		return -1;
+	}
+	seg = mmap(NULL, sizeof(llsim_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED) {
+		printf("llsim: couldn't map shared memory segment %s\n", seg_name);
+		seg = NULL;
+		return -1;
+	}
+	memset(seg, 0, sizeof(llsim_stats_t));
+	owner = getpid();
+	seg->pid = owner;
+	period = cycles > 0 ? cycles : 1;
+	seg->period = period;
+
+	for (unit = llsim->units; unit; unit = unit->next) {
+		for (reg = unit->registers; reg; reg = reg->next)
+			if (strcmp(reg->reg_name, "pc") == 0)
+				add_value(reg->unit_name, reg->reg_name, NULL, reg);
+		for (counter = unit->counters; counter; counter = counter->next)
+			add_value(counter->unit_name, counter->counter_name, counter->valp, NULL);
+	}
+	__atomic_store_n(&seg->magic, LLSIM_STATS_MAGIC, __ATOMIC_RELEASE);
+	atexit(remove_segment);
+
+	last_clock = llsim->clock;
+	last_ns = now_ns();
+	llsim_stats_publish();
+	printf("llsim: publishing statistics to %s every %d cycles\n", seg_name, period);
+	return 0;
+}
+
+void llsim_stats_publish(void)
+{
+	long long ns, val;
+	int i;
+
+	llsim->stats_next = llsim->clock + period;
+	ns = now_ns();
+
+	// seqlock write side: odd while the values are inconsistent
+	__atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&seg->clock, llsim->clock, __ATOMIC_RELAXED);
+	__atomic_store_n(&seg->time_ns, ns, __ATOMIC_RELAXED);
+	if (ns > last_ns)
+		__atomic_store_n(&seg->cycles_per_sec, (llsim->clock - last_clock) * 1000000000ll / (ns - last_ns), __ATOMIC_RELAXED);
+	for (i = 0; i < seg->nr_values; i++) {
+		if (counters[i])
+			val = *counters[i];
+		else
+			val = (unsigned int) *(int *) regs[i]->oldp & (regs[i]->bits < 32 ? (1u << regs[i]->bits) - 1 : ~0u);
+		__atomic_store_n(&seg->values[i], val, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELEASE);
+
+	last_clock = llsim->clock;
+	last_ns = ns;
+}
+
+/*
+ * called when the simulation ended. a forked sweep child only drops the
+ * parent's segment, the parent publishes nothing after the fork
+ */
+void llsim_stats_close(void)
+{
+	if (seg == NULL)
+		return;
+	if (owner == getpid()) {
+		llsim_stats_publish();
+		__atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		__atomic_store_n(&seg->done, 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&seg->seq, seg->seq + 1, __ATOMIC_RELEASE);
+		remove_segment();
+	}
+	munmap(seg, sizeof(llsim_stats_t));
+	seg = NULL;
+	llsim->stats_next = -1;
+}
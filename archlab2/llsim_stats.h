@@ -0,0 +1,34 @@
+#ifndef _LLSIM_STATS_H_
+#define _LLSIM_STATS_H_
+
+/*
+ * live statistics segment
+ *
+ * a running llsim started with -t name publishes its counters into the POSIX
+ * shared memory object name every period cycles. the names are written once
+ * before magic is set. the rest is protected by a seqlock: the simulator
+ * makes seq odd while it updates and even again when done, a reader retries
+ * its copy until it saw the same even seq before and after it. the reader
+ * never writes to the segment, so it cannot slow down the simulator.
+ */
+#define LLSIM_STATS_MAGIC	0x6c6c7331	// "lls1"
+#define LLSIM_STATS_MAX_VALUES	128
+#define LLSIM_STATS_NAME_LEN	48
+
+typedef struct llsim_stats_s {
+	unsigned int magic;
+	int pid;
+	int period;
+	int nr_values;
+	char names[LLSIM_STATS_MAX_VALUES][LLSIM_STATS_NAME_LEN];
+
+	// seqlock protected
+	unsigned int seq;
+	int done;			// 1 once the simulation ended
+	long long clock;
+	long long time_ns;		// CLOCK_MONOTONIC of the update
+	long long cycles_per_sec;	// over the last period
+	long long values[LLSIM_STATS_MAX_VALUES];
+} llsim_stats_t;
+
+#endif
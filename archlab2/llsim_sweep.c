@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "llsim.h"
+
+/*
+ * parameter sweeps
+ *
+ * the simulation runs once up to the fork cycle. then a child is forked per
+ * sweep point, sharing the loaded memories and registers copy-on-write. a
+ * child applies its point's assignments, runs to the end in its own
+ * directory sweep.<n> and leaves its counters and sram_out.txt hash in
+ * sweep.<n>/result.txt, which the parent collects into sweep_results.txt.
+ *
+ * a sweep file has one point per line of blank separated assignments:
+ *   unit.param=value       set a parameter
+ *   mem[addr]=value        inject a word into a memory
+ */
+#define SWEEP_MAX_POINTS	4096
+
+static char *points[SWEEP_MAX_POINTS];
+static int nr_points = 0;
+static int sweep_cycle = -1;
+static int point = -1;
+
+int llsim_sweep_load(char *file_name, int cycle)
+{
+	FILE *fp;
+	char line[1024], *p;
+
+	fp = fopen(file_name, "r");
+	if (fp == NULL) {
+		printf("llsim: couldn't open file %s\n", file_name);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		p = strchr(line, '#');
+		if (p)
+			*p = 0;
+		p = line + strlen(line);
+		while (p > line && (p[-1] == '\n' || p[-1] == ' ' || p[-1] == '\t'))
+			*--p = 0;
+		if (line[0] == 0)
+			continue;
+		if (nr_points == SWEEP_MAX_POINTS) {
+			printf("llsim: too many sweep points in %s\n", file_name);
+			return -1;
+		}
+		points[nr_points++] = strdup(line);
+	}
+	fclose(fp);
+	sweep_cycle = cycle;
+	return 0;
+}
+
+int llsim_sweep_cycle(void)
+{
+	return sweep_cycle;
+}
+
+static llsim_memory_t *find_memory(char *name)
+{
+	llsim_unit_t *unit;
+	llsim_memory_t *mem;
+
+	for (unit = llsim->units; unit; unit = unit->next)
+		for (mem = unit->mems; mem; mem = mem->next)
+			if (strcmp(mem->name, name) == 0)
+				return mem;
+	return NULL;
+}
+
+static void apply_point(char *assignments)
+{
+	llsim_memory_t *mem;
+	char buf[1024], *tok, *save, *eq, name[64];
+	int addr;
+
+	strcpy(buf, assignments);
+	for (tok = strtok_r(buf, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+		eq = strchr(tok, '=');
+		llsim_assert(eq != NULL, "ERROR: bad sweep assignment %s\n", tok);
+		if (sscanf(tok, "%63[^[][%i]=", name, &addr) == 2) {
+			mem = find_memory(name);
+			llsim_assert(mem != NULL && addr >= 0 && addr < mem->height, "ERROR: bad sweep assignment %s\n", tok);
+			llsim_mem_inject(mem, addr, strtol(eq + 1, NULL, 0), 31, 0);
+		} else {
+			*eq = 0;
+			llsim_set_param(tok, strtol(eq + 1, NULL, 0));
+		}
+	}
+}
+
+static void run_child(int n)
+{
+	char dir[32];
+
+	snprintf(dir, sizeof(dir), "sweep.%d", n);
+	mkdir(dir, 0755);
+	if (chdir(dir) < 0 || freopen("stdout.txt", "w", stdout) == NULL) {
+		printf("llsim: couldn't enter %s\n", dir);
+		exit(1);
+	}
+	llsim_reopen_files();
+	llsim_stats_close();
+	llsim->logging = 0;
+	llsim_par_after_fork();
+	point = n;
+	sweep_cycle = -1;
+	apply_point(points[n]);
+}
+
+/*
+ * writes point n's line of the results to out, returns -1 if the point failed
+ */
+static int collect(FILE *out, int n, int status)
+{
+	char file_name[64], line[256];
+	FILE *fp;
+
+	fprintf(out, "%d\t%s", n, points[n]);
+	snprintf(file_name, sizeof(file_name), "sweep.%d/result.txt", n);
+	fp = fopen(file_name, "r");
+	if (fp == NULL || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(out, "\tFAILED (status %d)\n", status);
+		if (fp)
+			fclose(fp);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		line[strcspn(line, "\n")] = 0;
+		if (strncmp(line, "llsim: counter ", 15) == 0)
+			fprintf(out, "\t%s", line + 15);
+		else
+			fprintf(out, "\t%s", line);
+	}
+	fprintf(out, "\n");
+	fclose(fp);
+	return 0;
+}
+
+/*
+ * called by the main loop at the fork cycle. returns only in the children,
+ * where llsim_sweep_cycle() is -1 from then on. the parent exits with 1 if
+ * any point failed
+ */
+void llsim_sweep_fork(void)
+{
+	pid_t *pids;
+	int *status, *failed;
+	int max_running, running, next, nr_failed, i, st;
+	pid_t pid;
+	FILE *out;
+
+	max_running = sysconf(_SC_NPROCESSORS_ONLN);
+	if (max_running < 1)
+		max_running = 1;
+	printf("llsim: clock %d: forking %d sweep points, %d at a time\n", llsim->clock, nr_points, max_running);
+	pids = (pid_t *) llsim_malloc(nr_points * sizeof(pid_t));
+	status = (int *) llsim_malloc(nr_points * sizeof(int));
+	failed = (int *) llsim_malloc(nr_points * sizeof(int));
+
+	running = 0;
+	next = 0;
+	while (next < nr_points || running > 0) {
+		if (next < nr_points && running < max_running) {
+			fflush(NULL);
+			pid = fork();
+			llsim_assert(pid >= 0, "ERROR: fork failed\n");
+			if (pid == 0) {
+				run_child(next);
+				return;
+			}
+			pids[next++] = pid;
+			running++;
+			continue;
+		}
+		pid = wait(&st);
+		if (pid < 0)
+			break;
+		for (i = 0; i < next; i++)
+			if (pids[i] == pid)
+				status[i] = st;
+		running--;
+	}
+
+	out = fopen("sweep_results.txt", "w");
+	llsim_assert(out != NULL, "ERROR: couldn't open file sweep_results.txt\n");
+	nr_failed = 0;
+	for (i = 0; i < nr_points; i++) {
+		failed[nr_failed] = i;
+		if (collect(out, i, status[i]) < 0)
+			nr_failed++;
+		collect(stdout, i, status[i]);
+	}
+	fclose(out);
+	if (nr_failed == 0)
+		exit(0);
+	printf("llsim: %d of %d sweep points failed:", nr_failed, nr_points);
+	for (i = 0; i < nr_failed; i++)
+		printf(" %d", failed[i]);
+	printf("\n");
+	exit(1);
+}
+
+/*
+ * called by a child when its simulation ended
+ */
+void llsim_sweep_finish(void)
+{
+	FILE *fp;
+
+	if (point < 0)
+		return;
+	fp = fopen("result.txt", "w");
+	llsim_assert(fp != NULL, "ERROR: couldn't open file result.txt\n");
+	fprintf(fp, "clock %d\n", llsim->clock);
+	fprintf(fp, "sram_out.txt %016llx\n", llsim_hash_file("sram_out.txt"));
+	llsim_print_counters(fp);
+	fclose(fp);
+}
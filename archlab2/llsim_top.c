@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "llsim_stats.h"
+
+/*
+ * llsim-top: show the live statistics of a running llsim -t name
+ *
+ * the segment is mapped read only and read with the seqlock protocol of
+ * llsim_stats.h, so watching a simulation does not slow it down.
+ */
+typedef struct snapshot_s {
+	int done;
+	long long clock;
+	long long time_ns;
+	long long cycles_per_sec;
+	long long values[LLSIM_STATS_MAX_VALUES];
+} snapshot_t;
+
+static void snapshot(const llsim_stats_t *seg, snapshot_t *snap)
+{
+	unsigned int seq0, seq1;
+	int i;
+
+	do {
+		while ((seq0 = __atomic_load_n(&seg->seq, __ATOMIC_ACQUIRE)) & 1)
+			usleep(100);
+		snap->done = __atomic_load_n(&seg->done, __ATOMIC_RELAXED);
+		snap->clock = __atomic_load_n(&seg->clock, __ATOMIC_RELAXED);
+		snap->time_ns = __atomic_load_n(&seg->time_ns, __ATOMIC_RELAXED);
+		snap->cycles_per_sec = __atomic_load_n(&seg->cycles_per_sec, __ATOMIC_RELAXED);
+		for (i = 0; i < seg->nr_values; i++)
+			snap->values[i] = __atomic_load_n(&seg->values[i], __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		seq1 = __atomic_load_n(&seg->seq, __ATOMIC_RELAXED);
+	} while (seq0 != seq1);
+}
+
+static void show(const llsim_stats_t *seg, char *name, snapshot_t *prev, snapshot_t *cur, int clear)
+{
+	double dt;
+	int i;
+
+	dt = (cur->time_ns - prev->time_ns) / 1e9;
+	if (clear)
+		printf("\033[H\033[2J");
+	printf("%s: pid %d clock %lld, %lld cycles/s%s\n", name, seg->pid, cur->clock, cur->cycles_per_sec,
+	       cur->done ? ", finished" : "");
+	for (i = 0; i < seg->nr_values; i++) {
+		if (strcmp(strrchr(seg->names[i], '.'), ".pc") == 0) {
+			printf("  %-40s 0x%llx\n", seg->names[i], cur->values[i]);
+			continue;
+		}
+		printf("  %-40s %16lld", seg->names[i], cur->values[i]);
+		if (dt > 0)
+			printf("  %14.0f/s", (cur->values[i] - prev->values[i]) / dt);
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+static void usage(char *prog)
+{
+	printf("usage: %s [-i interval_ms] [-n updates] name\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const llsim_stats_t *seg;
+	snapshot_t snap[2];
+	char name[128];
+	int opt, fd, interval = 1000, updates = -1, n, clear;
+
+	while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'n':
+			updates = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind >= argc || interval <= 0)
+		usage(argv[0]);
+	snprintf(name, sizeof(name), "%s%s", argv[optind][0] == '/' ? "" : "/", argv[optind]);
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		printf("llsim-top: no simulation publishes to %s\n", name);
+		exit(1);
+	}
+	seg = mmap(NULL, sizeof(llsim_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (seg == MAP_FAILED) {
+		printf("llsim-top: couldn't map %s\n", name);
+		exit(1);
+	}
+	while (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != LLSIM_STATS_MAGIC)
+		usleep(1000);
+
+	clear = isatty(1);
+	snapshot(seg, &snap[0]);
+	for (n = 1; updates < 0 || n <= updates; n++) {
+		usleep(interval * 1000);
+		snapshot(seg, &snap[n & 1]);
+		show(seg, name, &snap[(n - 1) & 1], &snap[n & 1], clear);
+		if (snap[n & 1].done)
+			break;
+	}
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "llsim.h"
+
+/*
+ * VCD waveform of every registered register up to 32 bits wide, one time
+ * step per clock, written for the cycles the traces are on
+ */
+#define VCD_MAX_REGS	1024
+
+static FILE *vcd_fp = NULL;
+static llsim_register_t *regs[VCD_MAX_REGS];
+static unsigned int last[VCD_MAX_REGS];
+static int nr_regs = 0;
+static int first = 1;
+
+static void vcd_id(int n, char *id)
+{
+	// printable ids '!' .. '~'
+	do {
+		*id++ = '!' + n % 94;
+		n /= 94;
+	} while (n);
+	*id = 0;
+}
+
+static void vcd_value(int n, unsigned int val)
+{
+	char id[8];
+	int i;
+
+	vcd_id(n, id);
+	if (regs[n]->bits == 1) {
+		fprintf(vcd_fp, "%d%s\n", val & 1, id);
+		return;
+	}
+	putc('b', vcd_fp);
+	for (i = regs[n]->bits - 1; i >= 0; i--)
+		putc('0' + ((val >> i) & 1), vcd_fp);
+	fprintf(vcd_fp, " %s\n", id);
+}
+
+int llsim_vcd_open(char *file_name)
+{
+	llsim_unit_t *unit;
+	llsim_register_t *reg;
+	char id[8];
+
+	vcd_fp = llsim_fopen(file_name, "w");
+	if (vcd_fp == NULL) {
+		printf("llsim: couldn't open file %s\n", file_name);
+		return -1;
+	}
+	fprintf(vcd_fp, "$timescale 1ns $end\n");
+	for (unit = llsim->units; unit; unit = unit->next) {
+		fprintf(vcd_fp, "$scope module %s $end\n", unit->name);
+		for (reg = unit->registers; reg; reg = reg->next) {
+			if (reg->bits > 32 || nr_regs == VCD_MAX_REGS)
+				continue;
+			vcd_id(nr_regs, id);
+			fprintf(vcd_fp, "$var reg %d %s %s $end\n", reg->bits, id, reg->reg_name);
+			regs[nr_regs++] = reg;
+		}
+		fprintf(vcd_fp, "$upscope $end\n");
+	}
+	fprintf(vcd_fp, "$enddefinitions $end\n");
+	return 0;
+}
+
+/*
+ * dump the registers that changed, at the start of the clock
+ */
+void llsim_vcd_sample(void)
+{
+	unsigned int val;
+	int i;
+
+	if (vcd_fp == NULL)
+		return;
+	fprintf(vcd_fp, "#%d\n", llsim->clock);
+	for (i = 0; i < nr_regs; i++) {
+		val = *(unsigned int *) regs[i]->oldp & bitmask0(regs[i]->bits);
+		if (!first && val == last[i])
+			continue;
+		vcd_value(i, val);
+		last[i] = val;
+	}
+	first = 0;
+}
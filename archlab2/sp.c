@@ -7,6 +7,7 @@
 //#include <netinet/in.h>
 
 #include "llsim.h"
+#include "sp.h"
 
 #define sp_printf(a...)						\
 	do {							\
@@ -14,7 +15,6 @@
 		llsim_printf(a);				\
 	} while (0)
 
-int nr_simulated_instructions = 0;
 FILE *inst_trace_fp = NULL, *cycle_trace_fp = NULL;
 
 typedef struct sp_registers_s {
@@ -72,20 +72,27 @@ typedef struct sp_registers_s {
 	//32 bit DMA count
 	unsigned int DMA_count;
 
-	// control states
-	#define CTL_STATE_IDLE		0
-	#define CTL_STATE_FETCH0	1
-	#define CTL_STATE_FETCH1	2
-	#define CTL_STATE_DEC0		3
-	#define CTL_STATE_DEC1		4
-	#define CTL_STATE_EXEC0		5
-	#define CTL_STATE_EXEC1		6
-
-	// DMA states
-	#define DMA_STATE_IDLE		 0
-	#define DMA_STATE_MEM_READ	 1
-	#define DMA_STATE_MEM_SAMPLE 2
-	#define DMA_STATE_MEM_WRITE	 3
+	// vector unit request
+	sp_vec_req_t vec_req;
+
+	// multiply / divide unit request
+	sp_muldiv_req_t muldiv_req;
+
+	// 1 bit interrupts enabled
+	int ie;
+
+	// 16 bit pc saved on interrupt entry
+	int epc;
+
+	// 16 bit interrupt vector
+	int ivec;
+
+	// 1 bit DMA transfer completed, valid for one cycle
+	int dma_irq;
+
+	// interrupt controller and timer requests
+	sp_intc_req_t intc_req;
+	sp_timer_req_t timer_req;
 
 } sp_registers_t;
 
@@ -93,16 +100,41 @@ typedef struct sp_registers_s {
  * Master structure
  */
 typedef struct sp_s {
-	// local sram
+	// local sram, paged. untouched words cost no host memory
 #define SP_SRAM_HEIGHT	64 * 1024
 	llsim_memory_t *sram;
+	int sram_height;
 
-	unsigned int memory_image[SP_SRAM_HEIGHT];
 	int memory_image_size;
 
 	sp_registers_t *spro, *sprn;
+
+	// vector unit outputs
+	int *vec_done;
+	int *vec_result;
+
+	// multiply / divide unit outputs
+	int *muldiv_done;
+	int *muldiv_result;
+
+	// interrupt controller outputs
+	int *intc_irq;
+	int *intc_pending;
 	
 	int start;
+
+	// parameters
+	int sram_out;
+
+	// counters
+	i64 nr_simulated_instructions;
+	i64 vec_stall_cycles;
+	i64 muldiv_stall_cycles;
+	i64 interrupts;
+	i64 wfi_cycles;
+	i64 dma_words;
+	i64 dma_blocked_cycles;
+	i64 mem_stall_cycles;
 } sp_t;
 
 static void sp_reset(sp_t *sp)
@@ -110,55 +142,80 @@ static void sp_reset(sp_t *sp)
 	sp_registers_t *sprn = sp->sprn;
 
 	memset(sprn, 0, sizeof(*sprn));
+	sp->start = 1;
 }
 
-/*
- * opcodes
- */
-#define ADD 0
-#define SUB 1
-#define LSF 2
-#define RSF 3
-#define AND 4
-#define OR  5
-#define XOR 6
-#define LHI 7
-#define LD 8
-#define ST 9
-#define JLT 16
-#define JLE 17
-#define JEQ 18
-#define JNE 19
-#define JIN 20
- //DMA opcode
-#define MEMCPY 21
-#define DMAPOL 22
-
-#define HLT 24
-
-
-
-static char opcode_name[32][4] = {"ADD", "SUB", "LSF", "RSF", "AND", "OR", "XOR", "LHI",
-				 "LD", "ST", "U", "U", "U", "U", "U", "U",
-				 "JLT", "JLE", "JEQ", "JNE", "JIN", "MEMCPY", "DMAPOL", "U",
-				 "HLT", "U", "U", "U", "U", "U", "U", "U"};
+char sp_opcode_name[32][8] = {"ADD", "SUB", "LSF", "RSF", "AND", "OR", "XOR", "LHI",
+				 "LD", "ST", "VLD", "VST", "VOP", "VRED", "MUL", "MULH",
+				 "JLT", "JLE", "JEQ", "JNE", "JIN", "MEMCPY", "DMAPOL", "VSPLAT",
+				 "HLT", "DIV", "REM", "RETI", "WFI", "TMR", "IEN", "IACK"};
 
 static void dump_sram(sp_t *sp)
 {
 	FILE *fp;
-	int i;
 
 	fp = fopen("sram_out.txt", "w");
 	if (fp == NULL) {
                 printf("couldn't open file sram_out.txt\n");
                 exit(1);
 	}
-	for (i = 0; i < SP_SRAM_HEIGHT; i++)
-		fprintf(fp, "%08x\n", llsim_mem_extract(sp->sram, i, 31, 0));
+	llsim_mem_dump_hex(sp->sram, fp, sp->sram_height);
 	fclose(fp);
 }
 
 
+/*
+ * observer filling inst_trace.txt, one line per instruction retired in the
+ * traced clocks. attached by sp_trace_start() only when some clocks are
+ * traced, so that -q runs do not post the retire events
+ */
+static void sp_trace_retire(const llsim_event_t *ev, void *arg)
+{
+	int inst = ev->b;
+
+	if (!llsim->trace)
+		return;
+	fprintf(inst_trace_fp, "clock %d pc %04x inst %08x %-6s dst %d src0 %d src1 %d imm %08x\n",
+		ev->clock, ev->a, inst, sp_opcode_name[sbs(inst, 29, 25)],
+		sbs(inst, 24, 22), sbs(inst, 21, 19), sbs(inst, 18, 16), sbs(inst, 15, 0));
+}
+
+void sp_trace_start(void)
+{
+	llsim_observe(LLSIM_EV_MASK(LLSIM_EV_RETIRE), sp_trace_retire, NULL);
+}
+
+int sp_alu_compute(int opcode, int a, int b)
+{
+	switch (opcode) {
+	case ADD:
+		return a + b;
+	case SUB:
+		return a - b;
+	case LSF:
+		return a << b;
+	case RSF:
+		return a >> b;
+	case AND:
+		return a & b;
+	case OR:
+		return a | b;
+	case XOR:
+		return a ^ b;
+	case LHI:
+		return (b << 16) | (a & 0xffff);
+	case JLT:
+		return a < b;
+	case JLE:
+		return a <= b;
+	case JEQ:
+		return a == b;
+	case JNE:
+		return a != b;
+	}
+	return 0;
+}
+
 static void sp_ctl(sp_t *sp)
 {
 	sp_registers_t *spro = sp->spro;
@@ -167,30 +224,37 @@ static void sp_ctl(sp_t *sp)
 
 	// sp_ctl
 
-	fprintf(cycle_trace_fp, "cycle %d\n", spro->cycle_counter);
-	for (i = 2; i <= 7; i++)
-		fprintf(cycle_trace_fp, "r%d %08x\n", i, spro->r[i]);
-	fprintf(cycle_trace_fp, "pc %08x\n", spro->pc);
-	fprintf(cycle_trace_fp, "inst %08x\n", spro->inst);
-	fprintf(cycle_trace_fp, "opcode %08x\n", spro->opcode);
-	fprintf(cycle_trace_fp, "dst %08x\n", spro->dst);
-	fprintf(cycle_trace_fp, "src0 %08x\n", spro->src0);
-	fprintf(cycle_trace_fp, "src1 %08x\n", spro->src1);
-	fprintf(cycle_trace_fp, "immediate %08x\n", spro->immediate);
-	fprintf(cycle_trace_fp, "alu0 %08x\n", spro->alu0);
-	fprintf(cycle_trace_fp, "alu1 %08x\n", spro->alu1);
-	fprintf(cycle_trace_fp, "aluout %08x\n", spro->aluout);
-	fprintf(cycle_trace_fp, "cycle_counter %08x\n", spro->cycle_counter);
-	fprintf(cycle_trace_fp, "ctl_state %08x\n", spro->ctl_state);
-	fprintf(cycle_trace_fp, "DMA_state %08x\n", spro->DMA_state);
-	fprintf(cycle_trace_fp, "DMA_count %08x\n", spro->DMA_count);
-	fprintf(cycle_trace_fp, "DMA_src %08x\n", spro->DMA_src);
-	fprintf(cycle_trace_fp, "DMA_dst %08x\n", spro->DMA_dst);
-	fprintf(cycle_trace_fp, "DMA_data %08x\n", spro->DMA_data);
+	if (llsim->trace) {
+		fprintf(cycle_trace_fp, "cycle %d\n", spro->cycle_counter);
+		for (i = 2; i <= 7; i++)
+			fprintf(cycle_trace_fp, "r%d %08x\n", i, spro->r[i]);
+		fprintf(cycle_trace_fp, "pc %08x\n", spro->pc);
+		fprintf(cycle_trace_fp, "inst %08x\n", spro->inst);
+		fprintf(cycle_trace_fp, "opcode %08x\n", spro->opcode);
+		fprintf(cycle_trace_fp, "dst %08x\n", spro->dst);
+		fprintf(cycle_trace_fp, "src0 %08x\n", spro->src0);
+		fprintf(cycle_trace_fp, "src1 %08x\n", spro->src1);
+		fprintf(cycle_trace_fp, "immediate %08x\n", spro->immediate);
+		fprintf(cycle_trace_fp, "alu0 %08x\n", spro->alu0);
+		fprintf(cycle_trace_fp, "alu1 %08x\n", spro->alu1);
+		fprintf(cycle_trace_fp, "aluout %08x\n", spro->aluout);
+		fprintf(cycle_trace_fp, "cycle_counter %08x\n", spro->cycle_counter);
+		fprintf(cycle_trace_fp, "ctl_state %08x\n", spro->ctl_state);
+		fprintf(cycle_trace_fp, "DMA_state %08x\n", spro->DMA_state);
+		fprintf(cycle_trace_fp, "DMA_count %08x\n", spro->DMA_count);
+		fprintf(cycle_trace_fp, "DMA_src %08x\n", spro->DMA_src);
+		fprintf(cycle_trace_fp, "DMA_dst %08x\n", spro->DMA_dst);
+		fprintf(cycle_trace_fp, "DMA_data %08x\n", spro->DMA_data);
+	}
 
 
 	sprn->cycle_counter = spro->cycle_counter + 1;
 
+	// one cycle pulses
+	sprn->intc_req.valid = 0;
+	sprn->timer_req.valid = 0;
+	sprn->dma_irq = 0;
+
 	switch (spro->ctl_state) {
 	case CTL_STATE_IDLE:
 		sprn->pc = 0;
@@ -201,17 +265,37 @@ static void sp_ctl(sp_t *sp)
 		}
 		else
 		{
-			dump_sram(sp);
+			if (sp->sram_out)
+				dump_sram(sp);
 			llsim_stop();
 		}
 		break;
 
 	case CTL_STATE_FETCH0:
-		llsim_mem_read(sp->sram, sp->spro->pc);
+		if (spro->ie && *sp->intc_irq) //take the interrupt instead of fetching
+		{
+			sprn->epc = spro->pc;
+			sprn->pc = spro->ivec;
+			sprn->ie = 0;
+			sp->interrupts++;
+			llsim_event(LLSIM_EV_IRQ, spro->pc, spro->ivec);
+			if (llsim->logging)
+				llsim_log_event(LLSIM_LOG_IRQ, spro->pc, spro->ivec);
+			break;
+		}
+		if (!llsim_mem_ready(sp->sram, spro->pc)) {
+			sp->mem_stall_cycles++;
+			break; //bank busy, fetch next cycle
+		}
+		llsim_mem_read_tag(sp->sram, spro->pc, SP_MEM_TAG_CPU);
 		sprn->ctl_state = CTL_STATE_FETCH1;
 		break;
 
 	case CTL_STATE_FETCH1:
+		if (!llsim_mem_valid(sp->sram, SP_MEM_TAG_CPU)) {
+			sp->mem_stall_cycles++;
+			break; //wait for the instruction
+		}
 		sprn->inst = llsim_mem_extract_dataout(sp->sram, 31, 0);
 		sprn->ctl_state = CTL_STATE_DEC0;
 		break;
@@ -254,46 +338,28 @@ static void sp_ctl(sp_t *sp)
 
 
 	case CTL_STATE_EXEC0:
+		if (spro->opcode == LD && !llsim_mem_ready(sp->sram, spro->alu1)) {
+			sp->mem_stall_cycles++;
+			break; //bank busy, load next cycle
+		}
 		switch (spro->opcode)
 		{
 		case ADD:
-			sprn->aluout = spro->alu0 + spro->alu1;
-			break;
 		case SUB:
-			sprn->aluout = spro->alu0 - spro->alu1;
-			break;
 		case LSF:
-			sprn->aluout = spro->alu0 << spro->alu1;
-			break;
 		case RSF:
-			sprn->aluout = spro->alu0 >> spro->alu1;
-			break;
 		case AND:
-			sprn->aluout = spro->alu0 & spro->alu1;
-			break;
 		case OR:
-			sprn->aluout = spro->alu0 | spro->alu1;
-			break;
 		case XOR:
-			sprn->aluout = spro->alu0 ^ spro->alu1;
-			break;
 		case LHI:
-			sprn->aluout = (spro->alu1 << 16) | generic_extract_bits(&spro->alu0, 15, 0);
-			break;
 		case JLT:
-			sprn->aluout = (spro->alu0 < spro->alu1) ? 1 : 0;
-			break;
 		case JLE:
-			sprn->aluout = (spro->alu0 <= spro->alu1) ? 1 : 0;
-			break;
 		case JEQ:
-			sprn->aluout = (spro->alu0 == spro->alu1) ? 1 : 0;
-			break;
 		case JNE:
-			sprn->aluout = (spro->alu0 != spro->alu1) ? 1 : 0;
+			sprn->aluout = sp_alu_compute(spro->opcode, spro->alu0, spro->alu1);
 			break;
 		case LD:
-			llsim_mem_read(sp->sram, spro->alu1);
+			llsim_mem_read_tag(sp->sram, spro->alu1, SP_MEM_TAG_CPU);
 			break;
 		case MEMCPY:
 			if (spro->DMA_state != DMA_STATE_IDLE)
@@ -306,6 +372,44 @@ static void sp_ctl(sp_t *sp)
 		case DMAPOL:
 			sprn->aluout = (spro->DMA_state == DMA_STATE_IDLE) ? 1 : 0; //0 -> DMA is busy, 1 -> DMA is available
 			break;
+		case VLD:
+		case VST:
+		case VOP:
+		case VRED:
+		case VSPLAT:
+			sprn->vec_req.valid = 1;
+			sprn->vec_req.opcode = spro->opcode;
+			sprn->vec_req.dst = spro->dst;
+			sprn->vec_req.src0 = spro->src0;
+			sprn->vec_req.src1 = spro->src1;
+			sprn->vec_req.immediate = spro->immediate;
+			sprn->vec_req.alu0 = spro->alu0;
+			sprn->vec_req.alu1 = spro->alu1;
+			break;
+		case MUL:
+		case MULH:
+		case DIV:
+		case REM:
+			sprn->muldiv_req.valid = 1;
+			sprn->muldiv_req.opcode = spro->opcode;
+			sprn->muldiv_req.alu0 = spro->alu0;
+			sprn->muldiv_req.alu1 = spro->alu1;
+			break;
+		case IEN:
+			sprn->intc_req.valid = 1;
+			sprn->intc_req.opcode = IEN;
+			sprn->intc_req.val = spro->alu0;
+			break;
+		case IACK:
+			sprn->aluout = *sp->intc_pending;
+			sprn->intc_req.valid = 1;
+			sprn->intc_req.opcode = IACK;
+			sprn->intc_req.val = *sp->intc_pending;
+			break;
+		case TMR:
+			sprn->timer_req.valid = 1;
+			sprn->timer_req.period = spro->alu0;
+			break;
 		default:
 			break; //do nothing
 		}
@@ -313,13 +417,37 @@ static void sp_ctl(sp_t *sp)
 		break;
 
 	case CTL_STATE_EXEC1:
+		if (sp_is_vec_op(spro->opcode)) {
+			sprn->vec_req.valid = 0;
+			if (!*sp->vec_done) {
+				sp->vec_stall_cycles++;
+				break; //wait for the vector unit
+			}
+		}
+		if (sp_is_muldiv_op(spro->opcode)) {
+			sprn->muldiv_req.valid = 0;
+			if (!*sp->muldiv_done) {
+				sp->muldiv_stall_cycles++;
+				break; //wait for the multiply / divide unit
+			}
+		}
+		if ((spro->opcode == LD && !llsim_mem_valid(sp->sram, SP_MEM_TAG_CPU)) ||
+		    (spro->opcode == ST && !llsim_mem_ready(sp->sram, spro->r[spro->src1]))) {
+			sp->mem_stall_cycles++;
+			break; //wait for the loaded data / a free bank
+		}
 		sprn->pc = spro->pc + 1 % 0xffff; //Increase PC
 		sprn->ctl_state = CTL_STATE_FETCH0;
-		nr_simulated_instructions++;
+		sp->nr_simulated_instructions++;
+		llsim_event(LLSIM_EV_RETIRE, spro->pc, spro->inst);
+		if (llsim->logging)
+			llsim_log_event(LLSIM_LOG_RETIRE, spro->pc, spro->inst);
 		switch (sp->spro->opcode)
 		{
 		case LD:
 			sprn->r[spro->dst] = llsim_mem_extract_dataout(sp->sram, 31, 0);
+			if (llsim->logging)
+				llsim_log_event(LLSIM_LOG_LOAD, spro->alu1, sprn->r[spro->dst]);
 			break;
 		case ST:
 			llsim_mem_set_datain(sp->sram, spro->r[spro->src0], 31, 0);
@@ -344,15 +472,53 @@ static void sp_ctl(sp_t *sp)
 			break;
 		case MEMCPY:
 			break;
+		case VRED:
+			if (sp_vred_defined(spro->immediate & 0xf))
+				sprn->r[spro->dst] = *sp->vec_result;
+			break;
+		case MUL:
+		case MULH:
+		case DIV:
+		case REM:
+			sprn->r[spro->dst] = *sp->muldiv_result;
+			break;
+		case VLD:
+		case VST:
+		case VOP:
+		case VSPLAT:
+			break;
+		case IEN:
+			sprn->ie = (spro->alu0 != 0);
+			sprn->ivec = spro->alu1;
+			break;
+		case RETI:
+			sprn->pc = spro->epc;
+			sprn->ie = 1;
+			break;
+		case WFI:
+			sprn->ctl_state = CTL_STATE_WFI;
+			break;
+		case TMR:
+			break;
 		default: //all other opcodes
 			sprn->r[spro->dst] = spro->aluout;
 		}
 		break;
+
+	case CTL_STATE_WFI:
+		sp->wfi_cycles++;
+		if (*sp->intc_irq)
+			sprn->ctl_state = CTL_STATE_FETCH0;
+		break;
 	}
 
 	if (((spro->ctl_state == CTL_STATE_FETCH0) || (spro->ctl_state == CTL_STATE_EXEC0 && spro->opcode == LD) ||
-		(spro->ctl_state == CTL_STATE_EXEC1 && spro->opcode == ST)) && spro->DMA_state != DMA_STATE_MEM_SAMPLE) 
-		return; //memory is busy, and DMA is not in sample state (that does not occupy memory) -> DMA does nothing.
+		(spro->ctl_state == CTL_STATE_EXEC1 && spro->opcode == ST) ||
+		(spro->ctl_state == CTL_STATE_EXEC1 && (spro->opcode == VLD || spro->opcode == VST))) && spro->DMA_state != DMA_STATE_MEM_SAMPLE) {
+		if (spro->DMA_state != DMA_STATE_IDLE)
+			sp->dma_blocked_cycles++;
+		return; //memory is busy (cpu or vector unit), and DMA is not in sample state (that does not occupy memory) -> DMA does nothing.
+	}
 
 	//else: memory is free to use by DMA
 	switch (spro->DMA_state)
@@ -362,24 +528,40 @@ static void sp_ctl(sp_t *sp)
 	case DMA_STATE_MEM_READ:
 		if (spro->DMA_count > 0)
 		{
-			llsim_mem_read(sp->sram, spro->DMA_src);
+			if (!llsim_mem_ready(sp->sram, spro->DMA_src))
+				break; //bank busy
+			llsim_mem_read_tag(sp->sram, spro->DMA_src, SP_MEM_TAG_DMA);
 			sprn->DMA_state = DMA_STATE_MEM_SAMPLE;
 		}
 		else
+		{
 			sprn->DMA_state = DMA_STATE_IDLE;
+			sprn->dma_irq = 1;
+		}
 		break;
 	case DMA_STATE_MEM_SAMPLE:
+		if (!llsim_mem_valid(sp->sram, SP_MEM_TAG_DMA))
+			break; //wait for the data
 		sprn->DMA_data = llsim_mem_extract_dataout(sp->sram, 31, 0);
 		sprn->DMA_state = DMA_STATE_MEM_WRITE;
 		break;
 	case DMA_STATE_MEM_WRITE:
+		if (!llsim_mem_ready(sp->sram, spro->DMA_dst))
+			break; //bank busy
 		llsim_mem_set_datain(sp->sram, spro->DMA_data, 31, 0);
 		llsim_mem_write(sp->sram, spro->DMA_dst);
 		sprn->DMA_count = spro->DMA_count - 1;
 		sprn->DMA_src = spro->DMA_src + 1;
 		sprn->DMA_dst = spro->DMA_dst + 1;
+		sp->dma_words++;
+		llsim_event(LLSIM_EV_DMA, spro->DMA_dst, spro->DMA_data);
+		if (llsim->logging)
+			llsim_log_event(LLSIM_LOG_DMA, spro->DMA_dst, spro->DMA_data);
 		if (spro->DMA_count - 1 == 0)
+		{
 			sprn->DMA_state = DMA_STATE_IDLE;
+			sprn->dma_irq = 1;
+		}
 		else
 			sprn->DMA_state = DMA_STATE_MEM_READ;
 		break;
@@ -388,7 +570,7 @@ static void sp_ctl(sp_t *sp)
 	}
 }
 
-static void sp_run(llsim_unit_t *unit)
+LLSIM_UNIT_RUN void sp_run(llsim_unit_t *unit)
 {
 	sp_t *sp = (sp_t *) unit->private;
 
@@ -397,16 +579,16 @@ static void sp_run(llsim_unit_t *unit)
 		return;
 	}
 
-	sp->sram->read = 0;
-	sp->sram->write = 0;
-
 	sp_ctl(sp);
+	llsim_event_state("ctl_state", sp->spro->ctl_state, sp->sprn->ctl_state);
+	llsim_event_state("DMA_state", sp->spro->DMA_state, sp->sprn->DMA_state);
 }
 
 static void sp_generate_sram_memory_image(sp_t *sp, char *program_name)
 {
         FILE *fp;
-        int addr, i;
+        unsigned int word;
+        int addr;
 
         fp = fopen(program_name, "r");
         if (fp == NULL) {
@@ -414,8 +596,9 @@ static void sp_generate_sram_memory_image(sp_t *sp, char *program_name)
                 exit(1);
         }
         addr = 0;
-        while (addr < SP_SRAM_HEIGHT) {
-                fscanf(fp, "%08x\n", &sp->memory_image[addr]);
+        while (addr < sp->sram_height) {
+                fscanf(fp, "%08x\n", &word);
+                llsim_mem_inject(sp->sram, addr, word, 31, 0);
                 addr++;
                 if (feof(fp))
                         break;
@@ -423,9 +606,6 @@ static void sp_generate_sram_memory_image(sp_t *sp, char *program_name)
 	sp->memory_image_size = addr;
 
         fprintf(inst_trace_fp, "program %s loaded, %d lines\n", program_name, addr);
-
-	for (i = 0; i < sp->memory_image_size; i++)
-		llsim_mem_inject(sp->sram, i, sp->memory_image[i], 31, 0);
 }
 
 static void sp_register_all_registers(sp_t *sp)
@@ -454,6 +634,32 @@ static void sp_register_all_registers(sp_t *sp)
 	llsim_register_register("sp", "immediate", 32, 0, &spro->immediate, &sprn->immediate);
 	llsim_register_register("sp", "cycle_counter", 32, 0, &spro->cycle_counter, &sprn->cycle_counter);
 	llsim_register_register("sp", "ctl_state", 3, 0, &spro->ctl_state, &sprn->ctl_state);
+	llsim_register_register("sp", "ie", 1, 0, &spro->ie, &sprn->ie);
+	llsim_register_register("sp", "epc", 16, 0, &spro->epc, &sprn->epc);
+	llsim_register_register("sp", "ivec", 16, 0, &spro->ivec, &sprn->ivec);
+	llsim_register_register("sp", "DMA_state", 2, 0, &spro->DMA_state, &sprn->DMA_state);
+	llsim_register_register("sp", "DMA_src", 32, 0, &spro->DMA_src, &sprn->DMA_src);
+	llsim_register_register("sp", "DMA_dst", 32, 0, &spro->DMA_dst, &sprn->DMA_dst);
+	llsim_register_register("sp", "DMA_data", 32, 0, &spro->DMA_data, &sprn->DMA_data);
+	llsim_register_register("sp", "DMA_count", 32, 0, &spro->DMA_count, &sprn->DMA_count);
+
+	// outputs
+	llsim_register_output("sp", "vec_req", 8 * sizeof(sp_vec_req_t), &spro->vec_req, &sprn->vec_req);
+	llsim_register_output("sp", "muldiv_req", 8 * sizeof(sp_muldiv_req_t), &spro->muldiv_req, &sprn->muldiv_req);
+	llsim_register_output("sp", "intc_req", 8 * sizeof(sp_intc_req_t), &spro->intc_req, &sprn->intc_req);
+	llsim_register_output("sp", "timer_req", 8 * sizeof(sp_timer_req_t), &spro->timer_req, &sprn->timer_req);
+	llsim_register_output("sp", "dma_irq", 1, &spro->dma_irq, &sprn->dma_irq);
+
+	// counters
+	llsim_register_counter("sp", "instructions", &sp->nr_simulated_instructions);
+	llsim_register_counter("sp", "vec_stall_cycles", &sp->vec_stall_cycles);
+	llsim_register_counter("sp", "muldiv_stall_cycles", &sp->muldiv_stall_cycles);
+	llsim_register_counter("sp", "interrupts", &sp->interrupts);
+	llsim_register_counter("sp", "wfi_cycles", &sp->wfi_cycles);
+	llsim_register_counter("sp", "dma_words", &sp->dma_words);
+	llsim_register_counter("sp", "dma_blocked_cycles", &sp->dma_blocked_cycles);
+	llsim_register_counter("sp", "mem_stall_cycles", &sp->mem_stall_cycles);
+	llsim_register_counter("sp", "sram_pages", &sp->sram->pages_allocated);
 }
 
 void sp_init(char *program_name)
@@ -464,13 +670,13 @@ void sp_init(char *program_name)
 
 	llsim_printf("initializing sp unit\n");
 
-	inst_trace_fp = fopen("inst_trace.txt", "w");
+	inst_trace_fp = llsim_fopen("inst_trace.txt", "w");
 	if (inst_trace_fp == NULL) {
 		printf("couldn't open file inst_trace.txt\n");
 		exit(1);
 	}
 
-	cycle_trace_fp = fopen("cycle_trace.txt", "w");
+	cycle_trace_fp = llsim_fopen("cycle_trace.txt", "w");
 	if (cycle_trace_fp == NULL) {
 		printf("couldn't open file cycle_trace.txt\n");
 		exit(1);
@@ -483,10 +689,28 @@ void sp_init(char *program_name)
 	sp->spro = llsim_ur->old;
 	sp->sprn = llsim_ur->new;
 
-	sp->sram = llsim_allocate_memory(llsim_sp_unit, "sram", 32, SP_SRAM_HEIGHT, 0);
-	sp_generate_sram_memory_image(sp, program_name);
+	llsim_register_param("sp", "sram_height", &sp->sram_height, SP_SRAM_HEIGHT);
+	sp->sram = llsim_allocate_paged_memory(llsim_sp_unit, "sram", 32, sp->sram_height, 0);
+	llsim_mem_register_timing(sp->sram, "sp");
+	llsim_register_param("sp", "sram_out", &sp->sram_out, 1);
+	// no program file when fuzzing, see sp_fuzz.c
+	if (program_name)
+		sp_generate_sram_memory_image(sp, program_name);
+	sp_mmio_init(sp->sram);
 
 	sp->start = 1;
 
 	sp_register_all_registers(sp);
+
+	sp_vec_init();
+	sp->vec_done = llsim_find_output("sp_vec", "done")->oldp;
+	sp->vec_result = llsim_find_output("sp_vec", "result")->oldp;
+
+	sp_muldiv_init();
+	sp->muldiv_done = llsim_find_output("sp_muldiv", "done")->oldp;
+	sp->muldiv_result = llsim_find_output("sp_muldiv", "result")->oldp;
+
+	sp_intc_init();
+	sp->intc_irq = llsim_find_output("sp_intc", "irq")->oldp;
+	sp->intc_pending = llsim_find_output("sp_intc", "pending")->oldp;
 }
@@ -0,0 +1,232 @@
+#ifndef _SP_H_
+#define _SP_H_
+
+/*
+ * opcodes
+ */
+#define ADD 0
+#define SUB 1
+#define LSF 2
+#define RSF 3
+#define AND 4
+#define OR  5
+#define XOR 6
+#define LHI 7
+#define LD 8
+#define ST 9
+ //vector opcodes
+#define VLD 10
+#define VST 11
+#define VOP 12
+#define VRED 13
+ //multiply / divide opcodes
+#define MUL 14
+#define MULH 15
+#define JLT 16
+#define JLE 17
+#define JEQ 18
+#define JNE 19
+#define JIN 20
+ //DMA opcode
+#define MEMCPY 21
+#define DMAPOL 22
+#define VSPLAT 23
+
+#define HLT 24
+#define DIV 25
+#define REM 26
+ //interrupt opcodes
+#define RETI 27
+#define WFI 28
+#define TMR 29
+#define IEN 30
+#define IACK 31
+
+extern char sp_opcode_name[32][8];
+
+/*
+ * result of the ALU opcodes ADD .. LHI, and 1 where the condition of JLT ..
+ * JNE holds. shared with the reference model in sp_check.c
+ */
+int sp_alu_compute(int opcode, int a, int b);
+
+/*
+ * control states
+ */
+#define CTL_STATE_IDLE		0
+#define CTL_STATE_FETCH0	1
+#define CTL_STATE_FETCH1	2
+#define CTL_STATE_DEC0		3
+#define CTL_STATE_DEC1		4
+#define CTL_STATE_EXEC0		5
+#define CTL_STATE_EXEC1		6
+#define CTL_STATE_WFI		7
+
+/*
+ * DMA states
+ */
+#define DMA_STATE_IDLE		 0
+#define DMA_STATE_MEM_READ	 1
+#define DMA_STATE_MEM_SAMPLE 2
+#define DMA_STATE_MEM_WRITE	 3
+
+/*
+ * vector extension
+ *
+ * VLD    v[dst] <- sram[alu1 .. alu1 + SP_VEC_LEN - 1]
+ * VST    sram[alu1 .. alu1 + SP_VEC_LEN - 1] <- v[src0]
+ * VOP    v[dst] <- v[src0] op v[src1], op = immediate[3:0]
+ * VRED   r[dst] <- reduction of v[src0], op = immediate[3:0]
+ * VSPLAT v[dst] <- alu0 in every element
+ *
+ * a VOP or VRED with an undefined op leaves its destination as it was, like
+ * the other unused encodings.
+ */
+#define SP_VEC_LEN	8
+#define SP_VEC_REGS	8
+
+// VOP operations
+#define VOP_ADD 0
+#define VOP_SUB 1
+#define VOP_AND 2
+#define VOP_OR  3
+#define VOP_XOR 4
+#define VOP_SHL 5
+#define VOP_SHR 6
+#define VOP_SEQ 7	// 1 where equal, 0 elsewhere
+
+// VRED operations
+#define VRED_ADD 0
+#define VRED_AND 1
+#define VRED_OR  2
+#define VRED_XOR 3
+
+static inline int sp_vop_defined(int op)
+{
+	return op >= VOP_ADD && op <= VOP_SEQ;
+}
+
+static inline int sp_vred_defined(int op)
+{
+	return op >= VRED_ADD && op <= VRED_XOR;
+}
+
+/*
+ * VOP and VRED with a defined op on SP_VEC_LEN element vectors, shared with
+ * the reference model in sp_check.c
+ */
+void sp_vec_compute(int op, int *d, const int *a, const int *b);
+int sp_vec_reduce(int op, const int *a);
+
+static inline int sp_is_vec_op(int opcode)
+{
+	return opcode == VLD || opcode == VST || opcode == VOP || opcode == VRED || opcode == VSPLAT;
+}
+
+/*
+ * sp -> vector unit request, valid for one cycle
+ */
+typedef struct sp_vec_req_s {
+	int valid;
+	int opcode;
+	int dst;
+	int src0;
+	int src1;
+	int immediate;
+	int alu0;
+	int alu1;
+} sp_vec_req_t;
+
+/*
+ * multiply / divide, executed by the sp_muldiv unit
+ *
+ * MUL    r[dst] <- low 32 bits of alu0 * alu1
+ * MULH   r[dst] <- high 32 bits of the signed 64 bit product
+ * DIV    r[dst] <- alu0 / alu1, rounded towards zero. -1 if alu1 is 0
+ * REM    r[dst] <- alu0 % alu1, sign of alu0. alu0 if alu1 is 0
+ */
+static inline int sp_is_muldiv_op(int opcode)
+{
+	return opcode == MUL || opcode == MULH || opcode == DIV || opcode == REM;
+}
+
+/*
+ * sp -> multiply / divide unit request, valid for one cycle
+ */
+typedef struct sp_muldiv_req_s {
+	int valid;
+	int opcode;
+	int alu0;
+	int alu1;
+} sp_muldiv_req_t;
+
+int sp_muldiv_compute(int opcode, int a, int b);
+
+/*
+ * interrupts
+ *
+ * IEN    interrupt mask <- alu0, interrupt vector <- alu1. interrupts are
+ *        enabled if the mask is not 0
+ * IACK   r[dst] <- pending interrupts, which are cleared
+ * TMR    timer period <- alu0 cycles, 0 stops the timer
+ * WFI    wait without accessing memory until an unmasked interrupt is pending
+ * RETI   pc <- saved pc, interrupts enabled
+ *
+ * a pending unmasked interrupt is taken instead of the next fetch while
+ * interrupts are enabled: the pc is saved, pc <- vector, interrupts disabled.
+ */
+#define SP_IRQ_DMA	1	// DMA transfer completed
+#define SP_IRQ_TIMER	2	// timer period elapsed
+
+/*
+ * sp -> interrupt controller request, valid for one cycle
+ */
+typedef struct sp_intc_req_s {
+	int valid;
+	int opcode;	// IEN or IACK
+	int val;	// mask for IEN, interrupts to clear for IACK
+} sp_intc_req_t;
+
+/*
+ * sp -> timer request, valid for one cycle
+ */
+typedef struct sp_timer_req_s {
+	int valid;
+	int period;
+} sp_timer_req_t;
+
+/*
+ * sram read tags, telling apart the reads in flight of the sram users
+ */
+#define SP_MEM_TAG_CPU	0
+#define SP_MEM_TAG_DMA	1
+#define SP_MEM_TAG_VEC	2
+
+/*
+ * memory mapped devices, see sp_mmio.c. word offsets from sp.mmio_base, by
+ * default SP_MMIO_BASE or the first multiple of it above a larger sram
+ *
+ * CONSOLE_CHAR   W  append the low byte to console.txt
+ * CONSOLE_DEC    W  append the value in decimal and a newline
+ * CONSOLE_HEX    W  append the value as 8 hex digits and a newline
+ * CONSOLE_FLUSH  W  write out the buffered console output
+ * CYCLES         R  clock cycle of the read
+ * BLK_WORDS      R  size of the block device in words, 0 without one
+ * BLK + i        RW word i of the block device file
+ */
+#define SP_MMIO_BASE		0x10000
+#define SP_MMIO_CONSOLE_CHAR	0x000
+#define SP_MMIO_CONSOLE_DEC	0x001
+#define SP_MMIO_CONSOLE_HEX	0x002
+#define SP_MMIO_CONSOLE_FLUSH	0x003
+#define SP_MMIO_CYCLES		0x010
+#define SP_MMIO_BLK_WORDS	0x020
+#define SP_MMIO_BLK		0x10000
+#define SP_MMIO_BLK_MAX_WORDS	0x10000000
+
+void sp_vec_init(void);
+void sp_muldiv_init(void);
+void sp_intc_init(void);
+void sp_mmio_init(llsim_memory_t *sram);
+
+#endif
@@ -0,0 +1,480 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "llsim.h"
+#include "sp.h"
+
+/*
+ * batched lockstep simulation
+ *
+ * runs the loaded program once per line of an input file, SP_BATCH_LANES
+ * instances at a time. the registers of the instances are kept as arrays
+ * of structures of vectors, one instance per lane, and every clock steps
+ * all lanes through the same cycle accurate control and DMA state machines
+ * as sp_ctl(), with lane masks selecting what each lane does. lanes whose
+ * instance halted are refilled with the next instance.
+ *
+ * llsim is built for the default x86-64 ISA, SSE2, where gcc splits every
+ * vector of 8 lanes in two. llsim-avx2 runs them in one register and
+ * llsim-avx512 has 16 lanes, make check runs the batch with each.
+ *
+ * an input line has blank separated sram[addr]=value assignments applied to
+ * the program image. instance n leaves sram_out.<n>.txt, identical to the
+ * sram_out.txt of a single run with the same memory contents, and a line
+ * in batch_results.txt.
+ *
+ * supported are the base ISA, MEMCPY / DMAPOL and the multiply / divide
+ * unit, with the default sram timing. the vector and interrupt opcodes stop
+ * the batch with an error.
+ */
+#ifdef __AVX512F__
+#define SP_BATCH_LANES	16
+#else
+#define SP_BATCH_LANES	8
+#endif
+
+typedef int bvec_t __attribute__ ((vector_size (SP_BATCH_LANES * sizeof(int))));
+
+#define BATCH_MAX_INSTANCES	(1 << 20)
+
+typedef struct sp_batch_registers_s {
+	bvec_t r[8];
+	bvec_t pc;
+	bvec_t inst;
+	bvec_t opcode;
+	bvec_t dst;
+	bvec_t src0;
+	bvec_t src1;
+	bvec_t immediate;
+	bvec_t alu0;
+	bvec_t alu1;
+	bvec_t aluout;
+	bvec_t ctl_state;
+	bvec_t start;
+	bvec_t DMA_state;
+	bvec_t DMA_src;
+	bvec_t DMA_dst;
+	bvec_t DMA_data;
+	bvec_t DMA_count;
+
+	// sp_muldiv unit and its request
+	bvec_t muldiv_req;
+	bvec_t md_busy;
+	bvec_t md_count;
+	bvec_t md_result;
+	bvec_t md_done;
+
+	// sram data out
+	bvec_t dataout;
+} sp_batch_registers_t;
+
+typedef struct sp_batch_s {
+	sp_batch_registers_t o, n;
+
+	// -1 in lanes running an instance
+	bvec_t running;
+
+	// per lane sram, entry addr of lane l at mem[addr * SP_BATCH_LANES + l]
+	int *mem;
+	int height;
+	int hi[SP_BATCH_LANES];		// highest address written + 1
+
+	int instance[SP_BATCH_LANES];
+	int start_clock[SP_BATCH_LANES];
+	i64 instructions[SP_BATCH_LANES];
+
+	int *image;
+	int image_size;
+	int mul_latency;
+	int div_latency;
+	int clock;
+} sp_batch_t;
+
+static char **lines;
+static int nr_lines;
+
+// vectors go to and from functions through pointers, by value their ABI changes with AVX
+#define splat(val)		((bvec_t) {} + (val))
+#define select(mask, a, b)	(((mask) & (a)) | (~(mask) & (b)))
+
+static inline int any(const bvec_t *mask)
+{
+	int i;
+
+	for (i = 0; i < SP_BATCH_LANES; i++)
+		if ((*mask)[i])
+			return 1;
+	return 0;
+}
+
+// *val <- r[idx] per lane
+static inline void reg_select(bvec_t *val, const bvec_t *r, const bvec_t *idx)
+{
+	int k;
+
+	*val = (bvec_t) {};
+	for (k = 0; k < 8; k++)
+		*val = select(*idx == k, r[k], *val);
+}
+
+// r[idx] <- val in the lanes of mask
+static inline void reg_write(bvec_t *r, const bvec_t *mask, const bvec_t *idx, const bvec_t *val)
+{
+	int k;
+
+	for (k = 0; k < 8; k++)
+		r[k] = select(*mask & (*idx == k), *val, r[k]);
+}
+
+static int supported(int opcode)
+{
+	return (opcode >= ADD && opcode <= ST) || opcode == MUL || opcode == MULH || opcode == DIV || opcode == REM ||
+		(opcode >= JLT && opcode <= JIN) || opcode == MEMCPY || opcode == DMAPOL || opcode == HLT;
+}
+
+static int load_lines(char *file_name)
+{
+	FILE *fp;
+	char line[4096], *p;
+
+	fp = fopen(file_name, "r");
+	if (fp == NULL) {
+		printf("llsim: couldn't open file %s\n", file_name);
+		return -1;
+	}
+	lines = (char **) llsim_malloc(BATCH_MAX_INSTANCES * sizeof(char *));
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		p = strchr(line, '#');
+		if (p)
+			*p = 0;
+		p = line + strlen(line);
+		while (p > line && (p[-1] == '\n' || p[-1] == ' ' || p[-1] == '\t'))
+			*--p = 0;
+		if (nr_lines == BATCH_MAX_INSTANCES) {
+			printf("llsim: too many instances in %s\n", file_name);
+			return -1;
+		}
+		lines[nr_lines++] = strdup(line);
+	}
+	fclose(fp);
+	return 0;
+}
+
+/*
+ * start instance n in lane l: sp_reset() state with start set, the program
+ * image and the instance's assignments in the lane's sram
+ */
+static void lane_start(sp_batch_t *b, int l, int n)
+{
+	sp_batch_registers_t *o = &b->o;
+	bvec_t *v;
+	char buf[4096], *tok, *save;
+	int addr, val, i, top;
+
+	for (v = (bvec_t *) o; v < (bvec_t *) (o + 1); v++)
+		(*v)[l] = 0;
+	o->start[l] = 1;
+	o->ctl_state[l] = CTL_STATE_IDLE;
+
+	top = b->hi[l] > b->image_size ? b->hi[l] : b->image_size;
+	for (i = 0; i < top; i++)
+		b->mem[i * SP_BATCH_LANES + l] = i < b->image_size ? b->image[i] : 0;
+	b->hi[l] = b->image_size;
+
+	strcpy(buf, lines[n]);
+	for (tok = strtok_r(buf, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+		llsim_assert(sscanf(tok, "sram[%i]=%i", &addr, &val) == 2 && addr >= 0 && addr < b->height,
+			     "ERROR: batch instance %d: bad assignment %s\n", n, tok);
+		b->mem[addr * SP_BATCH_LANES + l] = val;
+		if (addr >= b->hi[l])
+			b->hi[l] = addr + 1;
+	}
+
+	b->instance[l] = n;
+	b->start_clock[l] = b->clock;
+	b->instructions[l] = 0;
+	b->running[l] = -1;
+}
+
+static unsigned long long lane_dump(sp_batch_t *b, int l)
+{
+	static const char hex[] = "0123456789abcdef";
+	char file_name[64], *buf, *p;
+	unsigned int word;
+	int addr, i;
+	FILE *fp;
+
+	snprintf(file_name, sizeof(file_name), "sram_out.%d.txt", b->instance[l]);
+	fp = fopen(file_name, "w");
+	llsim_assert(fp != NULL, "ERROR: couldn't open file %s\n", file_name);
+	buf = (char *) llsim_malloc(b->height * 9);
+	p = buf;
+	for (addr = 0; addr < b->height; addr++) {
+		word = b->mem[addr * SP_BATCH_LANES + l];
+		for (i = 28; i >= 0; i -= 4)
+			*p++ = hex[(word >> i) & 0xf];
+		*p++ = '\n';
+	}
+	fwrite(buf, 1, p - buf, fp);
+	fclose(fp);
+	free(buf);
+	return llsim_hash_file(file_name);
+}
+
+/*
+ * one clock of all lanes, the equivalent of sp_ctl(), sp_muldiv_ctl() and
+ * the sram clock. o holds the old registers, n the new ones
+ */
+static void batch_clock(sp_batch_t *b, FILE *results)
+{
+	sp_batch_registers_t *o = &b->o, *n = &b->n;
+	bvec_t run = b->running;
+	bvec_t s_idle, s_f0, s_f1, s_d0, s_d1, s_e0, s_e1, stop, retire, stall, md_op;
+	bvec_t alu, op, rd, wr, addr, data, gate, d_read, d_sample, d_write, m, taken;
+	unsigned long long hash;
+	int l, bad;
+
+	*n = *o;
+	op = o->opcode;
+
+	s_idle = run & (o->ctl_state == CTL_STATE_IDLE);
+	s_f0 = run & (o->ctl_state == CTL_STATE_FETCH0);
+	s_f1 = run & (o->ctl_state == CTL_STATE_FETCH1);
+	s_d0 = run & (o->ctl_state == CTL_STATE_DEC0);
+	s_d1 = run & (o->ctl_state == CTL_STATE_DEC1);
+	s_e0 = run & (o->ctl_state == CTL_STATE_EXEC0);
+	s_e1 = run & (o->ctl_state == CTL_STATE_EXEC1);
+	rd = (bvec_t) {};
+	wr = (bvec_t) {};
+	addr = (bvec_t) {};
+	data = (bvec_t) {};
+
+	// IDLE: start, or the instance halted
+	n->pc = select(s_idle, splat(0), n->pc);
+	n->ctl_state = select(s_idle & (o->start != 0), splat(CTL_STATE_FETCH0), n->ctl_state);
+	n->start = select(s_idle, splat(0), n->start);
+	stop = s_idle & (o->start == 0);
+
+	// FETCH0, FETCH1
+	rd |= s_f0;
+	addr = select(s_f0, o->pc, addr);
+	n->ctl_state = select(s_f0, splat(CTL_STATE_FETCH1), n->ctl_state);
+	n->inst = select(s_f1, o->dataout, n->inst);
+	n->ctl_state = select(s_f1, splat(CTL_STATE_DEC0), n->ctl_state);
+
+	// DEC0
+	if (any(&s_d0)) {
+		n->opcode = select(s_d0, (o->inst >> 25) & 0x1f, n->opcode);
+		n->dst = select(s_d0, (o->inst >> 22) & 7, n->dst);
+		n->src0 = select(s_d0, (o->inst >> 19) & 7, n->src0);
+		n->src1 = select(s_d0, (o->inst >> 16) & 7, n->src1);
+		n->immediate = select(s_d0, o->inst & 0xffff, n->immediate);
+		n->ctl_state = select(s_d0, splat(CTL_STATE_DEC1), n->ctl_state);
+		for (l = 0; l < SP_BATCH_LANES; l++)
+			if (s_d0[l] && !supported(n->opcode[l]))
+				llsim_error("ERROR: batch instance %d: pc %d: opcode %d is not supported by the batch engine\n",
+					    b->instance[l], o->pc[l], n->opcode[l]);
+	}
+
+	// DEC1
+	if (any(&s_d1)) {
+		n->r[1] = select(s_d1, o->immediate, n->r[1]);
+		reg_select(&alu, o->r, &o->src0);
+		n->alu0 = select(s_d1, select(o->src0 == 0, splat(0), select(o->src0 == 1, o->immediate, alu)), n->alu0);
+		reg_select(&alu, o->r, &o->src1);
+		n->alu1 = select(s_d1, select(o->src1 == 0, splat(0), select(o->src1 == 1, o->immediate, alu)), n->alu1);
+		n->ctl_state = select(s_d1, splat(CTL_STATE_EXEC0), n->ctl_state);
+	}
+
+	// EXEC0
+	if (any(&s_e0)) {
+		alu = select(op == ADD, o->alu0 + o->alu1, (bvec_t) {});
+		alu = select(op == SUB, o->alu0 - o->alu1, alu);
+		alu = select(op == LSF, o->alu0 << (o->alu1 & 31), alu);
+		alu = select(op == RSF, o->alu0 >> (o->alu1 & 31), alu);
+		alu = select(op == AND, o->alu0 & o->alu1, alu);
+		alu = select(op == OR, o->alu0 | o->alu1, alu);
+		alu = select(op == XOR, o->alu0 ^ o->alu1, alu);
+		alu = select(op == LHI, (o->alu1 << 16) | (o->alu0 & 0xffff), alu);
+		alu = select(op == JLT, (o->alu0 < o->alu1) & 1, alu);
+		alu = select(op == JLE, (o->alu0 <= o->alu1) & 1, alu);
+		alu = select(op == JEQ, (o->alu0 == o->alu1) & 1, alu);
+		alu = select(op == JNE, (o->alu0 != o->alu1) & 1, alu);
+		alu = select(op == DMAPOL, (o->DMA_state == DMA_STATE_IDLE) & 1, alu);
+		m = s_e0 & (((op >= ADD) & (op <= LHI)) | ((op >= JLT) & (op <= JNE)) | (op == DMAPOL));
+		n->aluout = select(m, alu, n->aluout);
+
+		m = s_e0 & (op == LD);
+		rd |= m;
+		addr = select(m, o->alu1, addr);
+
+		m = s_e0 & (op == MEMCPY) & (o->DMA_state == DMA_STATE_IDLE);
+		n->DMA_state = select(m, splat(DMA_STATE_MEM_READ), n->DMA_state);
+		n->DMA_count = select(m, o->immediate, n->DMA_count);
+		n->DMA_src = select(m, o->alu0, n->DMA_src);
+		n->DMA_dst = select(m, o->alu1, n->DMA_dst);
+
+		m = s_e0 & ((op == MUL) | (op == MULH) | (op == DIV) | (op == REM));
+		n->muldiv_req = select(m, splat(1), n->muldiv_req);
+		n->ctl_state = select(s_e0, splat(CTL_STATE_EXEC1), n->ctl_state);
+	}
+
+	// EXEC1
+	if (any(&s_e1)) {
+		md_op = (op == MUL) | (op == MULH) | (op == DIV) | (op == REM);
+		n->muldiv_req = select(s_e1 & md_op, splat(0), n->muldiv_req);
+		stall = md_op & (o->md_done == 0);
+		retire = s_e1 & ~stall;
+		for (l = 0; l < SP_BATCH_LANES; l++)
+			b->instructions[l] -= retire[l];
+		n->pc = select(retire, o->pc + 1, n->pc);
+		n->ctl_state = select(retire, splat(CTL_STATE_FETCH0), n->ctl_state);
+
+		m = retire & (op == LD);
+		reg_write(n->r, &m, &o->dst, &o->dataout);
+
+		m = retire & (op == ST);
+		wr |= m;
+		reg_select(&alu, o->r, &o->src1);
+		addr = select(m, alu, addr);
+		reg_select(&alu, o->r, &o->src0);
+		data = select(m, alu, data);
+
+		taken = retire & (op >= JLT) & (op <= JNE) & (o->aluout == 1);
+		n->pc = select(taken, o->immediate, n->pc);
+		n->r[7] = select(taken, o->pc, n->r[7]);
+		m = retire & (op == JIN);
+		n->pc = select(m, o->src0, n->pc);
+		n->r[7] = select(m, o->pc, n->r[7]);
+
+		n->ctl_state = select(retire & (op == HLT), splat(CTL_STATE_IDLE), n->ctl_state);
+
+		m = retire & md_op;
+		reg_write(n->r, &m, &o->dst, &o->md_result);
+		m = retire & (((op >= ADD) & (op <= LHI)) | (op == DMAPOL));
+		reg_write(n->r, &m, &o->dst, &o->aluout);
+	}
+
+	// sp_muldiv
+	n->md_done = (bvec_t) {};
+	m = run & (o->md_busy == 0) & (o->muldiv_req != 0);
+	if (any(&m)) {
+		for (l = 0; l < SP_BATCH_LANES; l++) {
+			if (!m[l])
+				continue;
+			n->md_result[l] = sp_muldiv_compute(op[l], o->alu0[l], o->alu1[l]);
+			n->md_count[l] = (op[l] == MUL || op[l] == MULH) ? b->mul_latency : b->div_latency;
+		}
+		n->md_busy = select(m, splat(1), n->md_busy);
+	}
+	m = run & (o->md_busy != 0);
+	n->md_done = select(m & (o->md_count <= 1), splat(1), n->md_done);
+	n->md_busy = select(m & (o->md_count <= 1), splat(0), n->md_busy);
+	n->md_count = select(m, o->md_count - 1, n->md_count);
+
+	// DMA, when the cpu leaves the sram port free
+	gate = s_f0 | (s_e0 & (op == LD)) | (s_e1 & (op == ST));
+	m = run & ~(gate & (o->DMA_state != DMA_STATE_MEM_SAMPLE));
+	d_read = m & (o->DMA_state == DMA_STATE_MEM_READ);
+	d_sample = m & (o->DMA_state == DMA_STATE_MEM_SAMPLE);
+	d_write = m & (o->DMA_state == DMA_STATE_MEM_WRITE);
+
+	rd |= d_read & (o->DMA_count != 0);
+	addr = select(d_read & (o->DMA_count != 0), o->DMA_src, addr);
+	n->DMA_state = select(d_read, select(o->DMA_count != 0, splat(DMA_STATE_MEM_SAMPLE), splat(DMA_STATE_IDLE)), n->DMA_state);
+
+	n->DMA_data = select(d_sample, o->dataout, n->DMA_data);
+	n->DMA_state = select(d_sample, splat(DMA_STATE_MEM_WRITE), n->DMA_state);
+
+	wr |= d_write;
+	addr = select(d_write, o->DMA_dst, addr);
+	data = select(d_write, o->DMA_data, data);
+	n->DMA_count = select(d_write, o->DMA_count - 1, n->DMA_count);
+	n->DMA_src = select(d_write, o->DMA_src + 1, n->DMA_src);
+	n->DMA_dst = select(d_write, o->DMA_dst + 1, n->DMA_dst);
+	n->DMA_state = select(d_write, select(o->DMA_count == 1, splat(DMA_STATE_IDLE), splat(DMA_STATE_MEM_READ)), n->DMA_state);
+
+	// halted instances leave their sram as it was before this clock's accesses
+	if (any(&stop)) {
+		for (l = 0; l < SP_BATCH_LANES; l++) {
+			if (!stop[l])
+				continue;
+			hash = lane_dump(b, l);
+			fprintf(results, "%d\t%s\tclock %d\tsram_out.txt %016llx\tsp.instructions %lld\n", b->instance[l],
+				lines[b->instance[l]], b->clock - b->start_clock[l] + 6, hash, b->instructions[l]);
+		}
+		b->running &= ~stop;
+		rd &= ~stop;
+		wr &= ~stop;
+	}
+
+	// sram
+	bad = 0;
+	for (l = 0; l < SP_BATCH_LANES; l++) {
+		if (rd[l] | wr[l]) {
+			if (addr[l] < 0 || addr[l] >= b->height || (rd[l] && wr[l]))
+				bad = 1;
+			else if (rd[l])
+				n->dataout[l] = b->mem[addr[l] * SP_BATCH_LANES + l];
+			else {
+				b->mem[addr[l] * SP_BATCH_LANES + l] = data[l];
+				if (addr[l] >= b->hi[l])
+					b->hi[l] = addr[l] + 1;
+			}
+		} else
+			n->dataout[l] = 0xBAADBAAD;
+		if (bad)
+			llsim_error("ERROR: batch instance %d: clock %d: bad sram access to address %d\n",
+				    b->instance[l], b->clock - b->start_clock[l] + 5, addr[l]);
+	}
+
+	*o = *n;
+	b->clock++;
+}
+
+/*
+ * run every line of file_name as an instance, returns the exit status
+ */
+int sp_batch_run(char *file_name)
+{
+	llsim_memory_t *sram;
+	sp_batch_t *b;
+	FILE *results;
+	int next, l, addr;
+
+	sram = llsim_find_memory("sp", "sram");
+	llsim_assert(sram->read_latency == 1 && sram->write_latency == 1 && sram->bank_cycle == 1 && sram->banks == 1,
+		     "ERROR: the batch engine supports only the default sram timing\n");
+	if (load_lines(file_name) < 0)
+		return 1;
+
+	b = (sp_batch_t *) llsim_malloc_aligned(sizeof(sp_batch_t));
+	b->height = sram->height;
+	b->mem = (int *) llsim_malloc_aligned(b->height * SP_BATCH_LANES * sizeof(int));
+	b->image = (int *) llsim_malloc(b->height * sizeof(int));
+	for (addr = 0; addr < b->height; addr++) {
+		b->image[addr] = llsim_mem_extract(sram, addr, 31, 0);
+		if (b->image[addr])
+			b->image_size = addr + 1;
+	}
+	b->mul_latency = *llsim_find_param("sp_muldiv.mul_latency");
+	b->div_latency = *llsim_find_param("sp_muldiv.div_latency");
+
+	results = fopen("batch_results.txt", "w");
+	llsim_assert(results != NULL, "ERROR: couldn't open file batch_results.txt\n");
+	printf("llsim: running %d instances, %d lanes\n", nr_lines, SP_BATCH_LANES);
+
+	next = 0;
+	for (;;) {
+		for (l = 0; l < SP_BATCH_LANES && next < nr_lines; l++)
+			if (!b->running[l])
+				lane_start(b, l, next++);
+		if (!any(&b->running))
+			break;
+		batch_clock(b, results);
+	}
+	fclose(results);
+	printf("llsim: batch done after %d clocks\n", b->clock);
+	return 0;
+}
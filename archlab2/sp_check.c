@@ -0,0 +1,674 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "llsim.h"
+#include "sp.h"
+
+/*
+ * lockstep differential checking against a reference ISA model
+ *
+ * an observer on the simulation thread forwards the retired instructions,
+ * the data reads and stores of the sram, the DMA writes and the interrupts
+ * taken through a lock-free single producer single consumer queue to a
+ * checker thread. the checker executes each instruction on an ISA level
+ * model of the sp with its own copy of the sram, and compares the
+ * architectural state after every instruction: pc, instruction, r2 .. r7,
+ * the stores and the DMA writes. each side folds its state into a running
+ * hash, so a check is one compare while the two agree.
+ *
+ * the model has no notion of time. what depends on it is taken from the
+ * simulation: when interrupts are taken, the DMAPOL and IACK results, the
+ * order of the DMA writes among the instructions and the values read from
+ * the MMIO window. a data read is checked against the model's sram when it
+ * is issued and its value kept for the LD, VLD or DMA write it belongs to,
+ * so a load or a DMA racing a store is modelled as simulated. instruction
+ * fetches are not forwarded: a DMA into the code about to run may be
+ * reported as diverging.
+ *
+ * on the first divergence the clock, the pc and the differing fields are
+ * printed and the simulation stops.
+ */
+#define SP_CHECK_QUEUE		(1 << 14)	// records, a power of 2
+#define SP_CHECK_BATCH		1024		// records consumed before the head is published
+#define SP_CHECK_READS		16		// reads in flight per read tag
+#define SP_CHECK_STORES		16		// stores kept for a report, a power of 2
+
+#define SP_CHECK_RETIRE		0	// a = pc, b = instruction, r = registers before it
+#define SP_CHECK_STORE		1	// a = address, b = value
+#define SP_CHECK_DMA		2	// a = destination address, b = value
+#define SP_CHECK_IRQ		3	// a = interrupted pc, b = vector
+#define SP_CHECK_READ		4	// + read tag, a = address, b = value
+#define SP_CHECK_STOP		7	// r = final registers
+#define SP_CHECK_NR_TAGS	3
+
+typedef struct sp_check_rec_s {
+	int type;
+	int clock;
+	int a;
+	int b;
+	int r[8];
+} sp_check_rec_t;
+
+typedef struct sp_check_side_s {
+	unsigned long long arch_hash;	// pc, instruction and r2 .. r7 of every instruction
+	unsigned long long store_hash;
+	unsigned long long dma_hash;
+	i64 stores;
+	int store_addr[SP_CHECK_STORES];	// the last stores
+	int store_val[SP_CHECK_STORES];
+} sp_check_side_t;
+
+/*
+ * reference model state
+ */
+typedef struct sp_ref_s {
+	int pc;
+	int r[8];
+	int v[SP_VEC_REGS][SP_VEC_LEN];
+	int ie;
+	int ivec;
+	int epc;
+	int halted;
+	unsigned int adopt;		// registers to take from the simulation, see above
+	int last_clock;			// the instruction retired last
+	int last_pc;
+	int last_inst;
+
+	int *sram;
+	int height;
+
+	int dma_src;
+	int dma_dst;
+	int dma_left;
+	int dma_end_clock;		// clock of the last write of the last transfer
+
+	// reads issued by the simulation, not consumed yet, per read tag
+	int read_addr[SP_CHECK_NR_TAGS][SP_CHECK_READS];
+	int read_val[SP_CHECK_NR_TAGS][SP_CHECK_READS];
+	int nr_reads[SP_CHECK_NR_TAGS];
+} sp_ref_t;
+
+static sp_check_rec_t queue[SP_CHECK_QUEUE];
+static unsigned int q_tail __attribute__ ((aligned (64)));	// written by the simulation thread
+static unsigned int q_head __attribute__ ((aligned (64)));	// written by the checker thread
+static int diverged __attribute__ ((aligned (64)));
+
+// simulation thread
+static unsigned int tail, head_seen;
+static int *regs[8];
+static int *ctl_state;
+static llsim_memory_t *sram;
+static int dma_clock = -1;
+static int stopped;
+static i64 full_waits;
+
+// checker thread
+static pthread_t thread;
+static sp_ref_t ref;
+static sp_check_side_t sim_side, ref_side;
+static i64 checked, dma_writes;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	__asm__ __volatile__("" ::: "memory")
+#endif
+
+static inline unsigned long long mix(unsigned long long hash, int val)
+{
+	// FNV-1a on words
+	return (hash ^ (unsigned int) val) * 0x100000001b3ull;
+}
+
+/*
+ * queue, simulation side
+ */
+static sp_check_rec_t *reserve(int type, int clock, int a, int b)
+{
+	sp_check_rec_t *rec;
+	int spins = 0;
+
+	while (tail - head_seen == SP_CHECK_QUEUE) {
+		head_seen = __atomic_load_n(&q_head, __ATOMIC_ACQUIRE);
+		if (tail - head_seen < SP_CHECK_QUEUE)
+			break;
+		if (__atomic_load_n(&diverged, __ATOMIC_RELAXED))
+			return NULL;
+		if (spins++ == 0)
+			full_waits++;
+		if (spins < 1000)
+			cpu_relax();
+		else
+			sched_yield();
+	}
+	rec = &queue[tail % SP_CHECK_QUEUE];
+	rec->type = type;
+	rec->clock = clock;
+	rec->a = a;
+	rec->b = b;
+	return rec;
+}
+
+static inline void publish(void)
+{
+	__atomic_store_n(&q_tail, ++tail, __ATOMIC_RELEASE);
+}
+
+static void push(int type, int clock, int a, int b)
+{
+	if (reserve(type, clock, a, b))
+		publish();
+}
+
+static void push_regs(int type, int clock, int a, int b)
+{
+	sp_check_rec_t *rec;
+	int i;
+
+	rec = reserve(type, clock, a, b);
+	if (rec == NULL)
+		return;
+	for (i = 0; i < 8; i++)
+		rec->r[i] = *regs[i];
+	publish();
+}
+
+static void sp_check_event(const llsim_event_t *ev, void *arg)
+{
+	if (stopped)
+		return;
+	switch (ev->type) {
+	case LLSIM_EV_RETIRE:
+		if (__atomic_load_n(&diverged, __ATOMIC_RELAXED)) {
+			stopped = 1;
+			llsim_stop();
+			return;
+		}
+		// the registers still hold the results of the previous instruction
+		push_regs(SP_CHECK_RETIRE, ev->clock, ev->a, ev->b);
+		break;
+	case LLSIM_EV_MEM_WRITE:
+		// a DMA write comes as LLSIM_EV_DMA the same clock
+		if (ev->mem == sram && ev->clock != dma_clock)
+			push(SP_CHECK_STORE, ev->clock, ev->a, ev->b);
+		break;
+	case LLSIM_EV_MEM_READ:
+		// memory events are delivered as the memory clocks, with the tag of the read still set
+		if (ev->mem != sram)
+			break;
+		if (ev->mem->read_tag != SP_MEM_TAG_CPU || *ctl_state != CTL_STATE_FETCH0 ||
+		    (unsigned int) ev->a >= (unsigned int) sram->height)
+			push(SP_CHECK_READ + ev->mem->read_tag, ev->clock, ev->a, ev->b);
+		break;
+	case LLSIM_EV_DMA:
+		dma_clock = ev->clock;
+		push(SP_CHECK_DMA, ev->clock, ev->a, ev->b);
+		break;
+	case LLSIM_EV_IRQ:
+		push(SP_CHECK_IRQ, ev->clock, ev->a, ev->b);
+		break;
+	case LLSIM_EV_STOP:
+		stopped = 1;
+		push_regs(SP_CHECK_STOP, ev->clock, 0, 0);
+		break;
+	}
+}
+
+/*
+ * reference model
+ */
+static int bad_read;
+
+/*
+ * the oldest read with tag not consumed yet, which must be of addr
+ */
+static int ref_read(int tag, int addr)
+{
+	int val;
+
+	if (ref.nr_reads[tag] == 0 || ref.read_addr[tag][0] != addr) {
+		bad_read = 1;
+		return 0;
+	}
+	val = ref.read_val[tag][0];
+	ref.nr_reads[tag]--;
+	memmove(&ref.read_addr[tag][0], &ref.read_addr[tag][1], ref.nr_reads[tag] * sizeof(int));
+	memmove(&ref.read_val[tag][0], &ref.read_val[tag][1], ref.nr_reads[tag] * sizeof(int));
+	return val;
+}
+
+static int ref_fetch(int addr)
+{
+	if ((unsigned int) addr < (unsigned int) ref.height)
+		return ref.sram[addr];
+	return ref_read(SP_MEM_TAG_CPU, addr);
+}
+
+static void side_store(sp_check_side_t *side, int addr, int val)
+{
+	side->store_hash = mix(mix(side->store_hash, addr), val);
+	side->store_addr[side->stores % SP_CHECK_STORES] = addr;
+	side->store_val[side->stores % SP_CHECK_STORES] = val;
+	side->stores++;
+}
+
+static void ref_write(int addr, int val)
+{
+	if ((unsigned int) addr < (unsigned int) ref.height)
+		ref.sram[addr] = val;
+	side_store(&ref_side, addr, val);
+}
+
+/*
+ * executes one instruction retired at clock, with the semantics of sp_ctl()
+ */
+static void ref_exec(int inst, int clock)
+{
+	int opcode, dst, src0, src1, immediate, alu0, alu1, pc, i;
+
+	opcode = (inst >> 25) & 0x1f;
+	dst = (inst >> 22) & 7;
+	src0 = (inst >> 19) & 7;
+	src1 = (inst >> 16) & 7;
+	immediate = inst & 0xffff;
+	ref.r[1] = immediate;
+	alu0 = src0 ? ref.r[src0] : 0;
+	alu1 = src1 ? ref.r[src1] : 0;
+	pc = ref.pc + 1;
+
+	switch (opcode) {
+	case ADD:
+	case SUB:
+	case LSF:
+	case RSF:
+	case AND:
+	case OR:
+	case XOR:
+	case LHI:
+		ref.r[dst] = sp_alu_compute(opcode, alu0, alu1);
+		break;
+	case LD:
+		ref.r[dst] = ref_read(SP_MEM_TAG_CPU, alu1);
+		break;
+	case ST:
+		ref_write(ref.r[src1], ref.r[src0]);
+		break;
+	case JLT:
+	case JLE:
+	case JEQ:
+	case JNE:
+		if (sp_alu_compute(opcode, alu0, alu1)) {
+			pc = immediate;
+			ref.r[7] = ref.pc;
+		}
+		break;
+	case JIN:
+		pc = src0;
+		ref.r[7] = ref.pc;
+		break;
+	case MEMCPY:
+		// dropped while a transfer is in progress at EXEC0, the clock before
+		if (ref.dma_left > 0 || ref.dma_end_clock == clock - 1)
+			break;
+		ref.dma_src = alu0;
+		ref.dma_dst = alu1;
+		ref.dma_left = immediate;
+		break;
+	case DMAPOL:
+	case IACK:
+		ref.adopt |= 1 << dst;
+		break;
+	case VLD:
+		for (i = 0; i < SP_VEC_LEN; i++)
+			ref.v[dst][i] = ref_read(SP_MEM_TAG_VEC, alu1 + i);
+		break;
+	case VST:
+		for (i = 0; i < SP_VEC_LEN; i++)
+			ref_write(alu1 + i, ref.v[src0][i]);
+		break;
+	case VOP:
+		if (sp_vop_defined(immediate & 0xf))
+			sp_vec_compute(immediate & 0xf, ref.v[dst], ref.v[src0], ref.v[src1]);
+		break;
+	case VRED:
+		if (sp_vred_defined(immediate & 0xf))
+			ref.r[dst] = sp_vec_reduce(immediate & 0xf, ref.v[src0]);
+		break;
+	case VSPLAT:
+		for (i = 0; i < SP_VEC_LEN; i++)
+			ref.v[dst][i] = alu0;
+		break;
+	case MUL:
+	case MULH:
+	case DIV:
+	case REM:
+		ref.r[dst] = sp_muldiv_compute(opcode, alu0, alu1);
+		break;
+	case HLT:
+		ref.halted = 1;
+		break;
+	case IEN:
+		ref.ie = alu0 != 0;
+		ref.ivec = alu1;
+		break;
+	case RETI:
+		pc = ref.epc;
+		ref.ie = 1;
+		break;
+	case WFI:
+	case TMR:
+		break;
+	}
+	ref.pc = pc;
+}
+
+/*
+ * divergence reports
+ */
+static char report[4096];
+static int report_len;
+
+static void report_add(const char *fmt, ...)
+{
+	va_list ap;
+
+	if (report_len >= sizeof(report))
+		return;
+	va_start(ap, fmt);
+	report_len += vsnprintf(report + report_len, sizeof(report) - report_len, fmt, ap);
+	va_end(ap);
+}
+
+static void report_start(int clock, int pc)
+{
+	report_len = 0;
+	report_add("llsim: check: divergence at clock %d pc %04x, %lld instructions checked\n", clock, pc, checked);
+}
+
+static void report_inst(int inst)
+{
+	report_add("llsim: check:   %-9s %08x %s\n", "inst", inst, sp_opcode_name[(inst >> 25) & 0x1f]);
+}
+
+// the last instruction retired, whose results diverge
+static void report_last(void)
+{
+	if (ref.last_clock < 0) {
+		report_start(0, 0);
+		report_add("llsim: check:   before the first instruction\n");
+		return;
+	}
+	report_start(ref.last_clock, ref.last_pc);
+	report_inst(ref.last_inst);
+}
+
+static void report_field(const char *name, int sim, int model)
+{
+	if (sim != model)
+		report_add("llsim: check:   %-9s %08x, reference %08x\n", name, sim, model);
+}
+
+static int report_done(void)
+{
+	fputs(report, stdout);
+	fflush(stdout);
+	__atomic_store_n(&diverged, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static int check_stores(void)
+{
+	static i64 matched;
+	i64 i, n;
+	int k;
+
+	if (sim_side.stores == ref_side.stores && sim_side.store_hash == ref_side.store_hash) {
+		matched = sim_side.stores;
+		return 1;
+	}
+	report_last();
+	n = sim_side.stores < ref_side.stores ? sim_side.stores : ref_side.stores;
+	for (i = matched; i < n; i++) {
+		k = i % SP_CHECK_STORES;
+		if (i + SP_CHECK_STORES < sim_side.stores || i + SP_CHECK_STORES < ref_side.stores)
+			continue;
+		if (sim_side.store_addr[k] != ref_side.store_addr[k] || sim_side.store_val[k] != ref_side.store_val[k])
+			break;
+	}
+	if (i < n)
+		report_add("llsim: check:   store %lld sram[%x] = %08x, reference sram[%x] = %08x\n", i,
+			   sim_side.store_addr[k], sim_side.store_val[k], ref_side.store_addr[k], ref_side.store_val[k]);
+	else
+		report_add("llsim: check:   %lld stores, reference %lld\n", sim_side.stores, ref_side.stores);
+	return report_done();
+}
+
+/*
+ * compares the registers the simulation had before pc ran, and pc
+ */
+static int check_arch(const sp_check_rec_t *rec, int pc, int inst)
+{
+	char name[8];
+	int i, ref_inst;
+
+	ref_inst = pc < 0 ? 0 : ref_fetch(ref.pc);
+	for (i = 0; i < 8; i++)
+		if (ref.adopt & (1 << i))
+			ref.r[i] = rec->r[i];
+	ref.adopt = 0;
+
+	sim_side.arch_hash = mix(mix(sim_side.arch_hash, pc), inst);
+	ref_side.arch_hash = mix(mix(ref_side.arch_hash, pc < 0 ? pc : ref.pc), ref_inst);
+	for (i = 2; i < 8; i++) {
+		sim_side.arch_hash = mix(sim_side.arch_hash, rec->r[i]);
+		ref_side.arch_hash = mix(ref_side.arch_hash, ref.r[i]);
+	}
+	if (sim_side.arch_hash == ref_side.arch_hash)
+		return 1;
+
+	report_last();
+	if (pc >= 0) {
+		report_field("next pc", pc, ref.pc);
+		report_field("next inst", inst, ref_inst);
+	}
+	for (i = 2; i < 8; i++) {
+		snprintf(name, sizeof(name), "r%d", i);
+		report_field(name, rec->r[i], ref.r[i]);
+	}
+	return report_done();
+}
+
+static int check_retire(const sp_check_rec_t *rec)
+{
+	int vst = ((rec->b >> 25) & 0x1f) == VST;
+
+	if (ref.halted) {
+		report_start(rec->clock, rec->a);
+		report_inst(rec->b);
+		report_add("llsim: check:   retired after HLT\n");
+		return report_done();
+	}
+	if (!check_arch(rec, rec->a, rec->b))
+		return 0;
+	// the vector unit writes before VST retires, a ST writes as it retires
+	if (!vst && !check_stores())
+		return 0;
+	ref_exec(rec->b, rec->clock);
+	ref.last_clock = rec->clock;
+	ref.last_pc = rec->a;
+	ref.last_inst = rec->b;
+	checked++;
+	if (bad_read) {
+		report_last();
+		report_add("llsim: check:   no read of the data, or of another address\n");
+		return report_done();
+	}
+	if (vst && !check_stores())
+		return 0;
+	return 1;
+}
+
+static int check_dma(const sp_check_rec_t *rec)
+{
+	int val;
+
+	if (ref.dma_left <= 0) {
+		report_start(rec->clock, ref.pc);
+		report_add("llsim: check:   DMA write sram[%x] = %08x, no transfer in progress\n", rec->a, rec->b);
+		return report_done();
+	}
+	val = ref_read(SP_MEM_TAG_DMA, ref.dma_src);
+	if (bad_read) {
+		report_start(rec->clock, ref.pc);
+		report_add("llsim: check:   DMA write sram[%x] = %08x without a read of sram[%x]\n",
+			   rec->a, rec->b, ref.dma_src);
+		return report_done();
+	}
+	sim_side.dma_hash = mix(mix(sim_side.dma_hash, rec->a), rec->b);
+	ref_side.dma_hash = mix(mix(ref_side.dma_hash, ref.dma_dst), val);
+	if (sim_side.dma_hash != ref_side.dma_hash) {
+		report_start(rec->clock, ref.pc);
+		report_add("llsim: check:   DMA write sram[%x] = %08x, reference sram[%x] = %08x\n",
+			   rec->a, rec->b, ref.dma_dst, val);
+		return report_done();
+	}
+	if ((unsigned int) ref.dma_dst < (unsigned int) ref.height)
+		ref.sram[ref.dma_dst] = val;
+	ref.dma_src++;
+	ref.dma_dst++;
+	if (--ref.dma_left == 0)
+		ref.dma_end_clock = rec->clock;
+	dma_writes++;
+	return 1;
+}
+
+/*
+ * a read from the sram returns what the model holds at the time
+ */
+static int check_read(const sp_check_rec_t *rec, int tag)
+{
+	int n = ref.nr_reads[tag];
+
+	if ((unsigned int) rec->a < (unsigned int) ref.height && rec->b != ref.sram[rec->a]) {
+		report_start(rec->clock, ref.pc);
+		report_add("llsim: check:   read sram[%x] = %08x, reference %08x\n", rec->a, rec->b, ref.sram[rec->a]);
+		return report_done();
+	}
+	if (n == SP_CHECK_READS) {
+		report_start(rec->clock, ref.pc);
+		report_add("llsim: check:   %d reads of tag %d not used\n", n, tag);
+		return report_done();
+	}
+	ref.read_addr[tag][n] = rec->a;
+	ref.read_val[tag][n] = rec->b;
+	ref.nr_reads[tag]++;
+	return 1;
+}
+
+static int check_irq(const sp_check_rec_t *rec)
+{
+	if (!ref.ie || rec->a != ref.pc || rec->b != ref.ivec) {
+		report_start(rec->clock, ref.pc);
+		report_add("llsim: check:   interrupt at pc %04x to %04x, reference%s at pc %04x to %04x\n",
+			   rec->a, rec->b, ref.ie ? "" : " disabled", ref.pc, ref.ivec);
+		return report_done();
+	}
+	ref.epc = ref.pc;
+	ref.pc = ref.ivec;
+	ref.ie = 0;
+	return 1;
+}
+
+/*
+ * 1 to go on with the next record
+ */
+static int check(const sp_check_rec_t *rec)
+{
+	switch (rec->type) {
+	case SP_CHECK_RETIRE:
+		return check_retire(rec);
+	case SP_CHECK_STORE:
+		side_store(&sim_side, rec->a, rec->b);
+		return 1;
+	case SP_CHECK_DMA:
+		return check_dma(rec);
+	case SP_CHECK_IRQ:
+		return check_irq(rec);
+	case SP_CHECK_READ + SP_MEM_TAG_CPU:
+	case SP_CHECK_READ + SP_MEM_TAG_DMA:
+	case SP_CHECK_READ + SP_MEM_TAG_VEC:
+		return check_read(rec, rec->type - SP_CHECK_READ);
+	case SP_CHECK_STOP:
+		if (check_arch(rec, -1, 0))
+			check_stores();
+		return 0;
+	}
+	return 0;
+}
+
+static void *sp_check_thread(void *arg)
+{
+	unsigned int head = 0, tail_seen;
+	int spins = 0, n;
+
+	for (;;) {
+		tail_seen = __atomic_load_n(&q_tail, __ATOMIC_ACQUIRE);
+		if (head == tail_seen) {
+			if (++spins < 1000)
+				cpu_relax();
+			else
+				sched_yield();
+			continue;
+		}
+		spins = 0;
+		for (n = 0; head != tail_seen && n < SP_CHECK_BATCH; n++, head++)
+			if (!check(&queue[head % SP_CHECK_QUEUE]))
+				return NULL;
+		__atomic_store_n(&q_head, head, __ATOMIC_RELEASE);
+	}
+}
+
+/*
+ * called once the program is loaded, before the reset
+ */
+void sp_check_start(void)
+{
+	char name[16];
+	int i;
+
+	sram = llsim_find_memory("sp", "sram");
+	for (i = 0; i < 8; i++) {
+		snprintf(name, sizeof(name), "sp.r_%d", i);
+		regs[i] = (int *) llsim_find_register(name)->oldp;
+	}
+	ctl_state = (int *) llsim_find_register("sp.ctl_state")->oldp;
+
+	ref.height = sram->height;
+	ref.sram = (int *) llsim_malloc(ref.height * sizeof(int));
+	for (i = 0; i < ref.height; i++)
+		ref.sram[i] = llsim_mem_extract(sram, i, 31, 0);
+	ref.dma_end_clock = -1;
+	ref.last_clock = -1;
+
+	llsim_observe(LLSIM_EV_MASK(LLSIM_EV_RETIRE) | LLSIM_EV_MASK(LLSIM_EV_MEM_READ) | LLSIM_EV_MASK(LLSIM_EV_MEM_WRITE) |
+		      LLSIM_EV_MASK(LLSIM_EV_DMA) | LLSIM_EV_MASK(LLSIM_EV_IRQ) | LLSIM_EV_MASK(LLSIM_EV_STOP),
+		      sp_check_event, NULL);
+	llsim_assert(pthread_create(&thread, NULL, sp_check_thread, NULL) == 0, "ERROR: couldn't create thread\n");
+}
+
+/*
+ * waits for the checker to catch up. -1 if the simulation diverged
+ */
+int sp_check_finish(void)
+{
+	pthread_join(thread, NULL);
+	if (diverged)
+		return -1;
+	printf("llsim: check: %lld instructions, %lld stores, %lld DMA writes match the reference, queue full %lld times\n",
+	       checked, ref_side.stores, dma_writes, full_waits);
+	return 0;
+}
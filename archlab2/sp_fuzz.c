@@ -0,0 +1,412 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <setjmp.h>
+
+#include "llsim.h"
+#include "sp.h"
+
+/*
+ * in-process fuzzing
+ *
+ * generates random valid programs and runs them one after the other in the
+ * same process. the state after llsim_init() is kept in a snapshot, which
+ * every program starts from: restoring it only swaps back the sram pages
+ * the previous program wrote, so a program costs little more than the
+ * clocks it runs.
+ *
+ * a program is a prologue setting up the DMA address registers and maybe
+ * interrupts, a random body and HLT. the body mixes ALU, multiply / divide,
+ * vector, LD / ST, MEMCPY, DMAPOL, DMA poll loops, forward jumps, and ST
+ * of generated instructions into the code, ahead of or behind the pc. the
+ * generator only ever writes r2 .. r4 with arbitrary values, r5 and r6
+ * hold addresses in the data area, so every access stays in range and
+ * every program halts.
+ *
+ * every clock the registers are checked to fit their widths and the pc to
+ * stay in the program. a failed check, a failed llsim assertion or a
+ * program not halting within FUZZ_MAX_CLOCKS clocks fails the program,
+ * which is written to fuzz_fail.<n>.hex to be run on its own.
+ *
+ * coverage is counted per clock as ctl_state x opcode and DMA_state x
+ * ctl_state, and written to fuzz_coverage.txt.
+ */
+#define FUZZ_MAX_CODE		256
+#define FUZZ_DATA		0x400
+#define FUZZ_DATA_SIZE		256
+#define FUZZ_IMAGE		(FUZZ_DATA + FUZZ_DATA_SIZE)
+#define FUZZ_MAX_CLOCKS		200000
+#define FUZZ_MAX_DMA		8	// longest MEMCPY
+#define FUZZ_MAX_REGS		256
+
+typedef struct fuzz_prog_s {
+	unsigned int image[FUZZ_IMAGE];
+	int len;			// code words, including the interrupt handler
+	char protect[FUZZ_MAX_CODE];	// not to be overwritten by a ST into code
+	char target[FUZZ_MAX_CODE];	// a forward jump may land here
+	int jumps[FUZZ_MAX_CODE];	// jumps to patch with a target
+	int nr_jumps;
+	int stores[FUZZ_MAX_CODE];	// ST into code to patch with an address
+	int nr_stores;
+	int irq;			// interrupts enabled, with a timer running
+} fuzz_prog_t;
+
+static fuzz_prog_t prog;
+static unsigned int rng;
+
+static llsim_snapshot_t *snap;
+static llsim_memory_t *sram;
+static jmp_buf fail_jmp;
+
+// registers narrower than 32 bits and their masks
+static int *narrow[FUZZ_MAX_REGS];
+static unsigned int narrow_mask[FUZZ_MAX_REGS];
+static llsim_register_t *narrow_reg[FUZZ_MAX_REGS];
+static int nr_narrow;
+
+static int *pc, *opcode, *ctl_state, *DMA_state;
+
+static i64 cov_ctl[8][32];
+static i64 cov_dma[4][8];
+
+static char *ctl_state_name[8] = {"IDLE", "FETCH0", "FETCH1", "DEC0", "DEC1", "EXEC0", "EXEC1", "WFI"};
+static char *DMA_state_name[4] = {"IDLE", "READ", "SAMPLE", "WRITE"};
+
+static unsigned int rnd(unsigned int n)
+{
+	// xorshift32
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng % n;
+}
+
+static unsigned int encode(int op, int dst, int src0, int src1, int imm)
+{
+	return (op << 25) | (dst << 22) | (src0 << 19) | (src1 << 16) | (imm & 0xffff);
+}
+
+static int emit(unsigned int word, int protect, int target)
+{
+	int n = prog.len++;
+
+	prog.image[n] = word;
+	prog.protect[n] = protect;
+	prog.target[n] = target;
+	return n;
+}
+
+static int gpr(void)
+{
+	return 2 + rnd(3);
+}
+
+static int data_addr(int len)
+{
+	return FUZZ_DATA + rnd(FUZZ_DATA_SIZE - len + 1);
+}
+
+/*
+ * an instruction that only writes r2 .. r4
+ */
+static unsigned int simple_inst(void)
+{
+	static int ops[] = {ADD, SUB, LSF, RSF, AND, OR, XOR, LHI, MUL, MULH, DIV, REM};
+
+	return encode(ops[rnd(sizeof(ops) / sizeof(ops[0]))], gpr(), rnd(8), rnd(8), rnd(0x10000));
+}
+
+static void gen_item(void)
+{
+	unsigned int word;
+	int n;
+
+	switch (rnd(16)) {
+	case 0:
+	case 1:
+	case 2:
+	case 3:
+		emit(simple_inst(), 0, 1);
+		break;
+	case 4:
+		// LD from the data or the code
+		if (rnd(4))
+			emit(encode(LD, gpr(), 0, 1, data_addr(1)), 0, 1);
+		else
+			emit(encode(LD, gpr(), 0, 1, rnd(prog.len)), 0, 1);
+		break;
+	case 5:
+		emit(encode(ST, 0, 2 + rnd(6), 1, data_addr(1)), 0, 1);
+		break;
+	case 6:
+		// ST of a generated instruction into the code, address patched later
+		word = simple_inst();
+		emit(encode(ADD, 4, 1, 0, word & 0xffff), 1, 1);
+		emit(encode(LHI, 4, 4, 1, word >> 16), 1, 0);
+		prog.stores[prog.nr_stores++] = emit(encode(ST, 0, 4, 1, 0), 1, 0);
+		break;
+	case 7:
+		emit(encode(ADD, 5, 1, 0, data_addr(FUZZ_MAX_DMA)), 0, 1);
+		emit(encode(ADD, 6, 1, 0, data_addr(FUZZ_MAX_DMA)), 0, 1);
+		emit(encode(MEMCPY, 0, 5, 6, rnd(FUZZ_MAX_DMA + 1)), 0, 1);
+		break;
+	case 8:
+		emit(encode(MEMCPY, 0, 5, 6, rnd(FUZZ_MAX_DMA + 1)), 0, 1);
+		break;
+	case 9:
+		emit(encode(DMAPOL, gpr(), 0, 0, 0), 0, 1);
+		break;
+	case 10:
+		// wait for the DMA
+		n = emit(encode(DMAPOL, 4, 0, 0, 0), 1, 1);
+		emit(encode(JEQ, 0, 4, 0, n), 1, 0);
+		break;
+	case 11:
+	case 12:
+		prog.jumps[prog.nr_jumps++] = emit(encode(JLT + rnd(4), 0, rnd(8), rnd(8), 0), 0, 1);
+		break;
+	case 13:
+		switch (rnd(5)) {
+		case 0:
+			emit(encode(VLD, rnd(SP_VEC_REGS), 0, 1, data_addr(SP_VEC_LEN)), 0, 1);
+			break;
+		case 1:
+			emit(encode(VST, 0, rnd(SP_VEC_REGS), 1, data_addr(SP_VEC_LEN)), 0, 1);
+			break;
+		case 2:
+			emit(encode(VOP, rnd(SP_VEC_REGS), rnd(SP_VEC_REGS), rnd(SP_VEC_REGS), rnd(8)), 0, 1);
+			break;
+		case 3:
+			emit(encode(VRED, gpr(), rnd(SP_VEC_REGS), 0, rnd(4)), 0, 1);
+			break;
+		default:
+			emit(encode(VSPLAT, rnd(SP_VEC_REGS), rnd(8), 0, rnd(0x10000)), 0, 1);
+			break;
+		}
+		break;
+	default:
+		if (!prog.irq) {
+			emit(simple_inst(), 0, 1);
+			break;
+		}
+		switch (rnd(3)) {
+		case 0:
+			emit(encode(WFI, 0, 0, 0, 0), 0, 1);
+			break;
+		case 1:
+			emit(encode(IACK, gpr(), 0, 0, 0), 0, 1);
+			break;
+		default:
+			emit(encode(TMR, 0, 1, 0, 60 + rnd(400)), 0, 1);
+			break;
+		}
+		break;
+	}
+}
+
+static void generate(void)
+{
+	int len, hlt, ien = 0, i, n, t;
+
+	memset(&prog, 0, sizeof(prog));
+	for (i = 0; i < 16; i++)
+		prog.image[data_addr(1)] = rnd(0xffffffff);
+
+	emit(encode(ADD, 5, 1, 0, data_addr(FUZZ_MAX_DMA)), 1, 0);
+	emit(encode(ADD, 6, 1, 0, data_addr(FUZZ_MAX_DMA)), 1, 0);
+	prog.irq = rnd(2);
+	if (prog.irq) {
+		// the timer interrupt is never masked, so WFI always wakes up
+		emit(encode(ADD, 2, 1, 0, SP_IRQ_TIMER | rnd(2) * SP_IRQ_DMA), 1, 0);
+		ien = emit(encode(IEN, 0, 2, 1, 0), 1, 0);
+		emit(encode(TMR, 0, 1, 0, 60 + rnd(400)), 1, 0);
+	}
+
+	len = 8 + rnd(FUZZ_MAX_CODE - 16);
+	while (prog.len < len)
+		gen_item();
+	hlt = emit(encode(HLT, 0, 0, 0, 0), 1, 1);
+	if (prog.irq) {
+		prog.image[ien] |= prog.len;
+		emit(encode(IACK, 3, 0, 0, 0), 1, 0);
+		emit(encode(RETI, 0, 0, 0, 0), 1, 0);
+	}
+
+	// forward jumps to a random target up to the HLT
+	for (i = 0; i < prog.nr_jumps; i++) {
+		n = prog.jumps[i];
+		do {
+			t = n + 1 + rnd(hlt - n);
+		} while (!prog.target[t]);
+		prog.image[n] |= t;
+	}
+
+	// stores into any code word that is not protected, or the data
+	for (i = n = 0; i < hlt; i++)
+		n += !prog.protect[i];
+	for (i = 0; i < prog.nr_stores; i++) {
+		if (n == 0) {
+			prog.image[prog.stores[i]] |= data_addr(1);
+			continue;
+		}
+		do {
+			t = rnd(hlt);
+		} while (prog.protect[t]);
+		prog.image[prog.stores[i]] |= t;
+	}
+}
+
+static void fuzz_fail(void)
+{
+	longjmp(fail_jmp, 1);
+}
+
+static void write_program(char *file_name)
+{
+	FILE *fp;
+	int addr, end;
+
+	fp = fopen(file_name, "w");
+	if (fp == NULL) {
+		printf("llsim: couldn't open file %s\n", file_name);
+		return;
+	}
+	for (end = FUZZ_IMAGE; end > 0 && prog.image[end - 1] == 0; end--)
+		;
+	for (addr = 0; addr < end; addr++)
+		fprintf(fp, "%08x\n", prog.image[addr]);
+	fclose(fp);
+}
+
+static void check(void)
+{
+	int i;
+
+	for (i = 0; i < nr_narrow; i++)
+		llsim_assert((*narrow[i] & ~narrow_mask[i]) == 0, "ERROR: fuzz: register %s.%s = %08x wider than %d bits\n",
+			     narrow_reg[i]->unit_name, narrow_reg[i]->reg_name, *narrow[i], narrow_reg[i]->bits);
+	// HLT leaves the pc past the program
+	llsim_assert(*pc <= prog.len, "ERROR: fuzz: pc %04x outside the program\n", *pc);
+	cov_ctl[*ctl_state][*opcode]++;
+	cov_dma[*DMA_state][*ctl_state]++;
+}
+
+static void run_program(void)
+{
+	int addr;
+
+	llsim_snapshot_restore(snap);
+	for (addr = 0; addr < FUZZ_IMAGE; addr++)
+		if (prog.image[addr])
+			llsim_mem_inject(sram, addr, prog.image[addr], 31, 0);
+	llsim_reset();
+	while (!llsim_stopped()) {
+		llsim_run_clock();
+		llsim->clock++;
+		check();
+		llsim_assert(llsim->clock < FUZZ_MAX_CLOCKS, "ERROR: fuzz: program did not halt\n");
+	}
+}
+
+static int *find_register(char *name)
+{
+	llsim_register_t *reg;
+
+	reg = llsim_find_register(name);
+	llsim_assert(reg != NULL, "ERROR: couldn't find register %s\n", name);
+	return (int *) reg->oldp;
+}
+
+static void write_coverage(void)
+{
+	FILE *fp;
+	int s, op, n = 0, m = 0;
+
+	fp = fopen("fuzz_coverage.txt", "w");
+	llsim_assert(fp != NULL, "ERROR: couldn't open file fuzz_coverage.txt\n");
+	fprintf(fp, "clocks per ctl_state x opcode\n%-8s", "");
+	for (s = 0; s < 8; s++)
+		fprintf(fp, " %12s", ctl_state_name[s]);
+	fprintf(fp, "\n");
+	for (op = 0; op < 32; op++) {
+		fprintf(fp, "%-8s", sp_opcode_name[op]);
+		for (s = 0; s < 8; s++) {
+			fprintf(fp, " %12lld", cov_ctl[s][op]);
+			n += cov_ctl[s][op] != 0;
+		}
+		fprintf(fp, "\n");
+	}
+	fprintf(fp, "\nclocks per DMA_state x ctl_state\n%-8s", "");
+	for (s = 0; s < 8; s++)
+		fprintf(fp, " %12s", ctl_state_name[s]);
+	fprintf(fp, "\n");
+	for (op = 0; op < 4; op++) {
+		fprintf(fp, "%-8s", DMA_state_name[op]);
+		for (s = 0; s < 8; s++) {
+			fprintf(fp, " %12lld", cov_dma[op][s]);
+			m += cov_dma[op][s] != 0;
+		}
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+	printf("llsim: fuzz: coverage %d of %d ctl_state x opcode, %d of %d DMA_state x ctl_state\n", n, 8 * 32, m, 4 * 8);
+}
+
+int sp_fuzz_run(int nr_programs, unsigned int seed)
+{
+	llsim_unit_t *unit;
+	llsim_register_t *reg;
+	struct timespec t0, t1;
+	volatile i64 clocks = 0;
+	volatile int failed = 0;
+	volatile int n;
+	char file_name[64];
+	double dt;
+
+	sram = llsim_find_memory("sp", "sram");
+	pc = find_register("sp.pc");
+	opcode = find_register("sp.opcode");
+	ctl_state = find_register("sp.ctl_state");
+	DMA_state = find_register("sp.DMA_state");
+	for (unit = llsim->units; unit; unit = unit->next) {
+		for (reg = unit->registers; reg; reg = reg->next) {
+			if (reg->bits >= 32 || nr_narrow == FUZZ_MAX_REGS)
+				continue;
+			narrow[nr_narrow] = (int *) reg->oldp;
+			narrow_mask[nr_narrow] = bitmask0(reg->bits);
+			narrow_reg[nr_narrow++] = reg;
+		}
+	}
+	llsim_set_param("sp.sram_out", 0);
+	snap = llsim_snapshot_take();
+
+	printf("llsim: fuzz: %d programs, seed %u\n", nr_programs, seed);
+	llsim_fail_hook = fuzz_fail;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (n = 0; n < nr_programs; n++) {
+		// each program has its own seed, so any one can be generated again
+		rng = seed * 2654435761u + n * 40503u + 1;
+		if (rng == 0)
+			rng = 1;
+		generate();
+		if (setjmp(fail_jmp) == 0) {
+			run_program();
+			clocks += llsim->clock;
+			continue;
+		}
+		clocks += llsim->clock;
+		failed++;
+		snprintf(file_name, sizeof(file_name), "fuzz_fail.%d.hex", n);
+		write_program(file_name);
+		printf("llsim: fuzz: program %d failed at clock %d, written to %s\n", n, llsim->clock, file_name);
+	}
+	llsim_fail_hook = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	dt = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	printf("llsim: fuzz: %d programs, %d failed, %lld clocks, %.0f programs/s\n",
+	       nr_programs, failed, (i64) clocks, dt > 0 ? nr_programs / dt : 0.0);
+	write_coverage();
+	return failed ? 1 : 0;
+}
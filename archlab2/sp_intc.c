@@ -0,0 +1,181 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "llsim.h"
+#include "sp.h"
+
+/*
+ * timer unit
+ *
+ * raises tick for one cycle every period cycles, programmed by TMR
+ */
+typedef struct sp_timer_registers_s {
+	// 32 bit period, 0 when stopped
+	int period;
+
+	// 32 bit cycles until the next tick
+	int count;
+
+	// 1 bit tick
+	int tick;
+} sp_timer_registers_t;
+
+typedef struct sp_timer_s {
+	sp_timer_req_t *req;
+
+	sp_timer_registers_t *tro, *trn;
+
+	// counters
+	i64 ticks;
+} sp_timer_t;
+
+static void sp_timer_ctl(sp_timer_t *timer)
+{
+	sp_timer_registers_t *tro = timer->tro;
+	sp_timer_registers_t *trn = timer->trn;
+
+	trn->tick = 0;
+
+	if (timer->req->valid) {
+		trn->period = timer->req->period;
+		trn->count = timer->req->period;
+		return;
+	}
+	if (!tro->period)
+		return;
+	if (tro->count <= 1) {
+		trn->tick = 1;
+		trn->count = tro->period;
+		timer->ticks++;
+	} else {
+		trn->count = tro->count - 1;
+	}
+}
+
+LLSIM_UNIT_RUN void sp_timer_run(llsim_unit_t *unit)
+{
+	sp_timer_t *timer = (sp_timer_t *) unit->private;
+
+	if (llsim->reset) {
+		memset(timer->trn, 0, sizeof(*timer->trn));
+		return;
+	}
+
+	sp_timer_ctl(timer);
+}
+
+/*
+ * interrupt controller
+ *
+ * latches DMA completion and timer ticks into pending and raises irq while
+ * an unmasked interrupt is pending
+ */
+typedef struct sp_intc_registers_s {
+	// pending interrupts, SP_IRQ_* bits
+	int pending;
+
+	// enabled interrupts, SP_IRQ_* bits
+	int mask;
+
+	// 1 bit unmasked interrupt pending
+	int irq;
+} sp_intc_registers_t;
+
+typedef struct sp_intc_s {
+	sp_intc_req_t *req;
+	int *dma_irq;
+	int *timer_tick;
+
+	sp_intc_registers_t *iro, *irn;
+
+	// counters
+	i64 dma_irqs;
+	i64 timer_irqs;
+} sp_intc_t;
+
+static void sp_intc_ctl(sp_intc_t *intc)
+{
+	sp_intc_registers_t *iro = intc->iro;
+	sp_intc_registers_t *irn = intc->irn;
+	int pending, mask;
+
+	pending = iro->pending;
+	mask = iro->mask;
+	if (intc->req->valid) {
+		if (intc->req->opcode == IEN)
+			mask = intc->req->val;
+		else
+			pending &= ~intc->req->val;
+	}
+	if (*intc->dma_irq) {
+		pending |= SP_IRQ_DMA;
+		intc->dma_irqs++;
+	}
+	if (*intc->timer_tick) {
+		pending |= SP_IRQ_TIMER;
+		intc->timer_irqs++;
+	}
+
+	irn->pending = pending;
+	irn->mask = mask;
+	irn->irq = (pending & mask) != 0;
+}
+
+LLSIM_UNIT_RUN void sp_intc_run(llsim_unit_t *unit)
+{
+	sp_intc_t *intc = (sp_intc_t *) unit->private;
+
+	if (llsim->reset) {
+		memset(intc->irn, 0, sizeof(*intc->irn));
+		return;
+	}
+
+	sp_intc_ctl(intc);
+}
+
+void sp_intc_init(void)
+{
+	llsim_unit_t *llsim_timer_unit, *llsim_intc_unit;
+	llsim_unit_registers_t *llsim_ur;
+	sp_timer_t *timer;
+	sp_timer_registers_t *tro, *trn;
+	sp_intc_t *intc;
+	sp_intc_registers_t *iro, *irn;
+
+	llsim_printf("initializing sp_timer unit\n");
+
+	llsim_timer_unit = llsim_register_unit("sp_timer", sp_timer_run);
+	llsim_ur = llsim_allocate_registers(llsim_timer_unit, "sp_timer_registers", sizeof(sp_timer_registers_t));
+	timer = llsim_malloc(sizeof(sp_timer_t));
+	llsim_timer_unit->private = timer;
+	timer->tro = tro = llsim_ur->old;
+	timer->trn = trn = llsim_ur->new;
+
+	timer->req = llsim_find_output("sp", "timer_req")->oldp;
+
+	llsim_register_register("sp_timer", "period", 32, 0, &tro->period, &trn->period);
+	llsim_register_register("sp_timer", "count", 32, 0, &tro->count, &trn->count);
+	llsim_register_output("sp_timer", "tick", 1, &tro->tick, &trn->tick);
+	llsim_register_counter("sp_timer", "ticks", &timer->ticks);
+
+	llsim_printf("initializing sp_intc unit\n");
+
+	llsim_intc_unit = llsim_register_unit("sp_intc", sp_intc_run);
+	llsim_ur = llsim_allocate_registers(llsim_intc_unit, "sp_intc_registers", sizeof(sp_intc_registers_t));
+	intc = llsim_malloc(sizeof(sp_intc_t));
+	llsim_intc_unit->private = intc;
+	intc->iro = iro = llsim_ur->old;
+	intc->irn = irn = llsim_ur->new;
+
+	intc->req = llsim_find_output("sp", "intc_req")->oldp;
+	intc->dma_irq = llsim_find_output("sp", "dma_irq")->oldp;
+	intc->timer_tick = llsim_find_output("sp_timer", "tick")->oldp;
+
+	llsim_register_register("sp_intc", "pending", 2, 0, &iro->pending, &irn->pending);
+	llsim_register_register("sp_intc", "mask", 2, 0, &iro->mask, &irn->mask);
+	llsim_register_output("sp_intc", "irq", 1, &iro->irq, &irn->irq);
+	llsim_register_output("sp_intc", "pending", 2, &iro->pending, &irn->pending);
+	llsim_register_counter("sp_intc", "dma_irqs", &intc->dma_irqs);
+	llsim_register_counter("sp_intc", "timer_irqs", &intc->timer_irqs);
+}
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "llsim.h"
+#include "sp.h"
+
+/*
+ * memory mapped devices of the sp
+ *
+ * decoded on the sram bus at sp.mmio_base, so they are reached by LD, ST,
+ * MEMCPY and the vector unit alike, with the sram timing. see sp.h for the
+ * register map. mmio_base defaults to the first SP_MMIO_BASE boundary above
+ * the sram, a mmio_base set with -p must not overlap it.
+ *
+ * the console collects its output in a large stdio buffer and writes
+ * console.txt in bulk, when the buffer fills, on CONSOLE_FLUSH and when the
+ * simulation stops.
+ *
+ * the block device maps the host file given by -D, one 32 bit word per
+ * address. stores go straight to the file, so the children of a sweep
+ * share it. the file is an input the instruction log does not record, so
+ * -D is refused with -L and -R.
+ */
+#define SP_MMIO_CONSOLE_BUF	(1 << 20)
+
+typedef struct sp_mmio_s {
+	int base;
+	FILE *console_fp;
+	int *blk;
+	int blk_words;
+
+	// counters
+	i64 console_bytes;
+	i64 blk_reads;
+	i64 blk_writes;
+} sp_mmio_t;
+
+static char *blk_file_name = NULL;
+
+void sp_mmio_set_block_file(char *file_name)
+{
+	blk_file_name = file_name;
+}
+
+static int sp_mmio_regs_read(llsim_device_t *dev, unsigned int offset)
+{
+	sp_mmio_t *mmio = (sp_mmio_t *) dev->private;
+
+	switch (offset) {
+	case SP_MMIO_CYCLES:
+		return llsim->clock;
+	case SP_MMIO_BLK_WORDS:
+		return mmio->blk_words;
+	}
+	return 0;
+}
+
+static void sp_mmio_regs_write(llsim_device_t *dev, unsigned int offset, int val)
+{
+	sp_mmio_t *mmio = (sp_mmio_t *) dev->private;
+	int n = 0;
+
+	switch (offset) {
+	case SP_MMIO_CONSOLE_CHAR:
+		fputc(val, mmio->console_fp);
+		n = 1;
+		break;
+	case SP_MMIO_CONSOLE_DEC:
+		n = fprintf(mmio->console_fp, "%d\n", val);
+		break;
+	case SP_MMIO_CONSOLE_HEX:
+		n = fprintf(mmio->console_fp, "%08x\n", val);
+		break;
+	case SP_MMIO_CONSOLE_FLUSH:
+		fflush(mmio->console_fp);
+		break;
+	}
+	mmio->console_bytes += n;
+}
+
+static int sp_mmio_blk_read(llsim_device_t *dev, unsigned int offset)
+{
+	sp_mmio_t *mmio = (sp_mmio_t *) dev->private;
+
+	mmio->blk_reads++;
+	return mmio->blk[offset];
+}
+
+static void sp_mmio_blk_write(llsim_device_t *dev, unsigned int offset, int val)
+{
+	sp_mmio_t *mmio = (sp_mmio_t *) dev->private;
+
+	mmio->blk_writes++;
+	mmio->blk[offset] = val;
+}
+
+static void sp_mmio_stop(const llsim_event_t *ev, void *arg)
+{
+	sp_mmio_t *mmio = (sp_mmio_t *) arg;
+
+	fflush(mmio->console_fp);
+}
+
+static void sp_mmio_map_block(sp_mmio_t *mmio)
+{
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = open(blk_file_name, O_RDWR);
+	llsim_assert(fd >= 0, "ERROR: couldn't open block device file %s\n", blk_file_name);
+	llsim_assert(fstat(fd, &st) == 0, "ERROR: couldn't stat block device file %s\n", blk_file_name);
+	llsim_assert(st.st_size / 4 <= SP_MMIO_BLK_MAX_WORDS, "ERROR: block device file %s too large\n", blk_file_name);
+	mmio->blk_words = st.st_size / 4;
+	if (mmio->blk_words) {
+		p = mmap(NULL, mmio->blk_words * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		llsim_assert(p != MAP_FAILED, "ERROR: couldn't map block device file %s\n", blk_file_name);
+		mmio->blk = (int *) p;
+	}
+	close(fd);
+}
+
+void sp_mmio_init(llsim_memory_t *sram)
+{
+	sp_mmio_t *mmio;
+	unsigned int base;
+
+	base = ((unsigned int) sram->height + SP_MMIO_BASE - 1) & ~(SP_MMIO_BASE - 1);
+	if (base < SP_MMIO_BASE)
+		base = SP_MMIO_BASE;
+	mmio = llsim_malloc(sizeof(sp_mmio_t));
+	llsim_register_param("sp", "mmio_base", &mmio->base, base);
+	llsim_assert((unsigned int) mmio->base >= (unsigned int) sram->height,
+		     "ERROR: mmio_base %x inside the sram\n", mmio->base);
+
+	mmio->console_fp = llsim_fopen("console.txt", "w");
+	if (mmio->console_fp == NULL) {
+		printf("couldn't open file console.txt\n");
+		exit(1);
+	}
+	setvbuf(mmio->console_fp, NULL, _IOFBF, SP_MMIO_CONSOLE_BUF);
+	llsim_observe(LLSIM_EV_MASK(LLSIM_EV_STOP), sp_mmio_stop, mmio);
+
+	llsim_mem_map_device(sram, "mmio", mmio->base, SP_MMIO_BLK, sp_mmio_regs_read, sp_mmio_regs_write, mmio);
+	if (blk_file_name)
+		sp_mmio_map_block(mmio);
+	if (mmio->blk_words)
+		llsim_mem_map_device(sram, "blk", mmio->base + SP_MMIO_BLK, mmio->blk_words,
+				     sp_mmio_blk_read, sp_mmio_blk_write, mmio);
+
+	llsim_register_counter("sp", "console_bytes", &mmio->console_bytes);
+	llsim_register_counter("sp", "blk_reads", &mmio->blk_reads);
+	llsim_register_counter("sp", "blk_writes", &mmio->blk_writes);
+}
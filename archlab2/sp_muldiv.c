@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "llsim.h"
+#include "sp.h"
+
+/*
+ * multiply / divide unit
+ *
+ * iterative unit with one operation in flight. the result is computed when
+ * the request is accepted and held for mul_latency / div_latency cycles,
+ * then done is raised for one cycle. the sp stalls in EXEC1 until done.
+ */
+typedef struct sp_muldiv_registers_s {
+	// 1 bit busy
+	int busy;
+
+	// cycles left for the current operation
+	int count;
+
+	// 32 bit result
+	int result;
+
+	// 1 bit operation done
+	int done;
+} sp_muldiv_registers_t;
+
+typedef struct sp_muldiv_s {
+	sp_muldiv_req_t *req;
+
+	sp_muldiv_registers_t *mro, *mrn;
+
+	// parameters
+	int mul_latency;
+	int div_latency;
+
+	// counters
+	i64 mul_retired;
+	i64 div_retired;
+	i64 busy_cycles;
+} sp_muldiv_t;
+
+int sp_muldiv_compute(int opcode, int a, int b)
+{
+	switch (opcode) {
+	case MUL:
+		return (int) ((i64) a * (i64) b);
+	case MULH:
+		return (int) (((i64) a * (i64) b) >> 32);
+	case DIV:
+		if (b == 0)
+			return -1;
+		if (a == (int) 0x80000000 && b == -1)
+			return a;
+		return a / b;
+	case REM:
+		if (b == 0)
+			return a;
+		if (a == (int) 0x80000000 && b == -1)
+			return 0;
+		return a % b;
+	default:
+		llsim_error("ERROR: opcode %d is not a multiply / divide opcode\n", opcode);
+	}
+	return 0;
+}
+
+static void sp_muldiv_ctl(sp_muldiv_t *md)
+{
+	sp_muldiv_registers_t *mro = md->mro;
+	sp_muldiv_registers_t *mrn = md->mrn;
+	sp_muldiv_req_t *req = md->req;
+
+	mrn->done = 0;
+
+	if (!mro->busy) {
+		if (!req->valid)
+			return;
+		mrn->result = sp_muldiv_compute(req->opcode, req->alu0, req->alu1);
+		mrn->busy = 1;
+		if (req->opcode == MUL || req->opcode == MULH) {
+			mrn->count = md->mul_latency;
+			md->mul_retired++;
+		} else {
+			mrn->count = md->div_latency;
+			md->div_retired++;
+		}
+		return;
+	}
+
+	md->busy_cycles++;
+	if (mro->count <= 1) {
+		mrn->done = 1;
+		mrn->busy = 0;
+	}
+	mrn->count = mro->count - 1;
+}
+
+LLSIM_UNIT_RUN void sp_muldiv_run(llsim_unit_t *unit)
+{
+	sp_muldiv_t *md = (sp_muldiv_t *) unit->private;
+
+	if (llsim->reset) {
+		memset(md->mrn, 0, sizeof(*md->mrn));
+		return;
+	}
+
+	sp_muldiv_ctl(md);
+}
+
+void sp_muldiv_init(void)
+{
+	llsim_unit_t *llsim_muldiv_unit;
+	llsim_unit_registers_t *llsim_ur;
+	sp_muldiv_t *md;
+	sp_muldiv_registers_t *mro, *mrn;
+
+	llsim_printf("initializing sp_muldiv unit\n");
+
+	llsim_muldiv_unit = llsim_register_unit("sp_muldiv", sp_muldiv_run);
+	llsim_ur = llsim_allocate_registers(llsim_muldiv_unit, "sp_muldiv_registers", sizeof(sp_muldiv_registers_t));
+	md = llsim_malloc(sizeof(sp_muldiv_t));
+	llsim_muldiv_unit->private = md;
+	md->mro = mro = llsim_ur->old;
+	md->mrn = mrn = llsim_ur->new;
+
+	md->req = llsim_find_output("sp", "muldiv_req")->oldp;
+
+	llsim_register_param("sp_muldiv", "mul_latency", &md->mul_latency, 3);
+	llsim_register_param("sp_muldiv", "div_latency", &md->div_latency, 32);
+	llsim_assert(md->mul_latency >= 1 && md->div_latency >= 1, "ERROR: sp_muldiv latencies must be at least 1\n");
+
+	llsim_register_register("sp_muldiv", "busy", 1, 0, &mro->busy, &mrn->busy);
+	llsim_register_output("sp_muldiv", "done", 1, &mro->done, &mrn->done);
+	llsim_register_output("sp_muldiv", "result", 32, &mro->result, &mrn->result);
+
+	llsim_register_counter("sp_muldiv", "mul_retired", &md->mul_retired);
+	llsim_register_counter("sp_muldiv", "div_retired", &md->div_retired);
+	llsim_register_counter("sp_muldiv", "busy_cycles", &md->busy_cycles);
+}
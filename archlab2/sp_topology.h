@@ -0,0 +1,14 @@
+/*
+ * topology of the sp system for the static build (make llsim-static)
+ *
+ * the units in evaluation order, which is the reverse of the order sp_init()
+ * registers them in, with their run functions, then the memories. define
+ * LLSIM_UNIT(name, run) and LLSIM_MEMORY(unit, name) before including.
+ */
+LLSIM_UNIT(sp_intc, sp_intc_run)
+LLSIM_UNIT(sp_timer, sp_timer_run)
+LLSIM_UNIT(sp_muldiv, sp_muldiv_run)
+LLSIM_UNIT(sp_vec, sp_vec_run)
+LLSIM_UNIT(sp, sp_run)
+
+LLSIM_MEMORY(sp, sram)
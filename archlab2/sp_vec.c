@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "llsim.h"
+#include "sp.h"
+
+/*
+ * vector unit
+ *
+ * executes the vector opcodes dispatched by the sp. the sp stalls in EXEC1
+ * until done is raised for one cycle. element-wise operations are evaluated
+ * with host vector instructions, one SP_VEC_LEN element register per vector.
+ */
+typedef int vreg_t __attribute__ ((vector_size (SP_VEC_LEN * sizeof(int))));
+
+// latencies in cycles
+#define VEC_ALU_LATENCY	1
+#define VEC_RED_LATENCY	3	// log2(SP_VEC_LEN) adder tree levels
+
+typedef struct sp_vec_registers_s {
+	// SP_VEC_REGS vector registers
+	vreg_t v[SP_VEC_REGS];
+
+	// 2 bit state machine state register
+	int state;
+
+	// latched request
+	int opcode;
+	int dst;
+	int src0;
+
+	// 32 bit sram address of the next element
+	int addr;
+
+	// element index of loads / stores
+	int idx;
+
+	// element index of the next load data
+	int ridx;
+
+	// cycles left for alu operations
+	int count;
+
+	// 32 bit reduction result
+	int result;
+
+	// 1 bit operation done
+	int done;
+
+	// states
+	#define VEC_STATE_IDLE		0
+	#define VEC_STATE_LOAD		1
+	#define VEC_STATE_STORE		2
+	#define VEC_STATE_ALU		3
+} sp_vec_registers_t;
+
+typedef struct sp_vec_s {
+	llsim_memory_t *sram;
+
+	sp_vec_req_t *req;
+
+	sp_vec_registers_t *vro, *vrn;
+} sp_vec_t;
+
+void sp_vec_compute(int op, int *d, const int *a, const int *b)
+{
+	vreg_t va, vb, vd = {};
+
+	memcpy(&va, a, sizeof(vreg_t));
+	memcpy(&vb, b, sizeof(vreg_t));
+	switch (op) {
+	case VOP_ADD:
+		vd = va + vb;
+		break;
+	case VOP_SUB:
+		vd = va - vb;
+		break;
+	case VOP_AND:
+		vd = va & vb;
+		break;
+	case VOP_OR:
+		vd = va | vb;
+		break;
+	case VOP_XOR:
+		vd = va ^ vb;
+		break;
+	case VOP_SHL:
+		vd = va << (vb & 31);
+		break;
+	case VOP_SHR:
+		vd = va >> (vb & 31);
+		break;
+	case VOP_SEQ:
+		vd = -(va == vb);
+		break;
+	}
+	memcpy(d, &vd, sizeof(vreg_t));
+}
+
+int sp_vec_reduce(int op, const int *a)
+{
+	int i, val;
+
+	val = a[0];
+	for (i = 1; i < SP_VEC_LEN; i++) {
+		switch (op) {
+		case VRED_ADD:
+			val += a[i];
+			break;
+		case VRED_AND:
+			val &= a[i];
+			break;
+		case VRED_OR:
+			val |= a[i];
+			break;
+		case VRED_XOR:
+			val ^= a[i];
+			break;
+		}
+	}
+	return val;
+}
+
+static void sp_vec_accept(sp_vec_t *vec)
+{
+	sp_vec_registers_t *vro = vec->vro;
+	sp_vec_registers_t *vrn = vec->vrn;
+	sp_vec_req_t *req = vec->req;
+
+	vrn->opcode = req->opcode;
+	vrn->dst = req->dst;
+	vrn->src0 = req->src0;
+	vrn->addr = req->alu1;
+	vrn->idx = 0;
+	vrn->ridx = 0;
+
+	switch (req->opcode) {
+	case VLD:
+		vrn->state = VEC_STATE_LOAD;
+		break;
+	case VST:
+		vrn->state = VEC_STATE_STORE;
+		break;
+	case VOP:
+		if (sp_vop_defined(req->immediate & 0xf))
+			sp_vec_compute(req->immediate & 0xf, (int *) &vrn->v[req->dst],
+				       (const int *) &vro->v[req->src0], (const int *) &vro->v[req->src1]);
+		vrn->count = VEC_ALU_LATENCY;
+		vrn->state = VEC_STATE_ALU;
+		break;
+	case VSPLAT:
+		vrn->v[req->dst] = (vreg_t) {} + req->alu0;
+		vrn->count = VEC_ALU_LATENCY;
+		vrn->state = VEC_STATE_ALU;
+		break;
+	case VRED:
+		vrn->result = sp_vec_reduce(req->immediate & 0xf, (const int *) &vro->v[req->src0]);
+		vrn->count = VEC_RED_LATENCY;
+		vrn->state = VEC_STATE_ALU;
+		break;
+	default:
+		llsim_error("ERROR: opcode %d is not a vector opcode\n", req->opcode);
+	}
+}
+
+static void sp_vec_ctl(sp_vec_t *vec)
+{
+	sp_vec_registers_t *vro = vec->vro;
+	sp_vec_registers_t *vrn = vec->vrn;
+
+	vrn->done = 0;
+
+	switch (vro->state) {
+	case VEC_STATE_IDLE:
+		if (vec->req->valid)
+			sp_vec_accept(vec);
+		break;
+
+	case VEC_STATE_LOAD:
+		// up to one word read per cycle, the data arrives in order
+		if (vro->idx < SP_VEC_LEN && llsim_mem_ready(vec->sram, vro->addr)) {
+			llsim_mem_read_tag(vec->sram, vro->addr, SP_MEM_TAG_VEC);
+			vrn->addr = vro->addr + 1;
+			vrn->idx = vro->idx + 1;
+		}
+		if (llsim_mem_valid(vec->sram, SP_MEM_TAG_VEC)) {
+			vrn->v[vro->dst][vro->ridx] = llsim_mem_extract_dataout(vec->sram, 31, 0);
+			vrn->ridx = vro->ridx + 1;
+			if (vro->ridx == SP_VEC_LEN - 1) {
+				vrn->done = 1;
+				vrn->state = VEC_STATE_IDLE;
+			}
+		}
+		break;
+
+	case VEC_STATE_STORE:
+		if (!llsim_mem_ready(vec->sram, vro->addr))
+			break;
+		llsim_mem_set_datain(vec->sram, vro->v[vro->src0][vro->idx], 31, 0);
+		llsim_mem_write(vec->sram, vro->addr);
+		if (vro->idx == SP_VEC_LEN - 1) {
+			vrn->done = 1;
+			vrn->state = VEC_STATE_IDLE;
+		}
+		vrn->addr = vro->addr + 1;
+		vrn->idx = vro->idx + 1;
+		break;
+
+	case VEC_STATE_ALU:
+		if (vro->count == 1) {
+			vrn->done = 1;
+			vrn->state = VEC_STATE_IDLE;
+		}
+		vrn->count = vro->count - 1;
+		break;
+	}
+}
+
+LLSIM_UNIT_RUN void sp_vec_run(llsim_unit_t *unit)
+{
+	sp_vec_t *vec = (sp_vec_t *) unit->private;
+
+	if (llsim->reset) {
+		memset(vec->vrn, 0, sizeof(*vec->vrn));
+		return;
+	}
+
+	sp_vec_ctl(vec);
+}
+
+void sp_vec_init(void)
+{
+	llsim_unit_t *llsim_vec_unit;
+	llsim_unit_registers_t *llsim_ur;
+	sp_vec_t *vec;
+	sp_vec_registers_t *vro, *vrn;
+
+	llsim_printf("initializing sp_vec unit\n");
+
+	llsim_vec_unit = llsim_register_unit("sp_vec", sp_vec_run);
+	llsim_ur = llsim_allocate_registers(llsim_vec_unit, "sp_vec_registers", sizeof(sp_vec_registers_t));
+	vec = llsim_malloc(sizeof(sp_vec_t));
+	llsim_vec_unit->private = vec;
+	vec->vro = vro = llsim_ur->old;
+	vec->vrn = vrn = llsim_ur->new;
+
+	vec->sram = llsim_find_memory("sp", "sram");
+	vec->req = llsim_find_output("sp", "vec_req")->oldp;
+
+	llsim_register_register("sp_vec", "state", 2, 0, &vro->state, &vrn->state);
+	llsim_register_output("sp_vec", "done", 1, &vro->done, &vrn->done);
+	llsim_register_output("sp_vec", "result", 32, &vro->result, &vrn->result);
+}